@@ -54,7 +54,9 @@ typedef enum
     ST_EOF
 } ParserState;
 
+static int openFile(const wchar_t *path, size_t _fieldCnt);
 static int readHeader(void);
+static int countHeaderFields(size_t *cnt);
 static int readValue(wchar_t *buf, size_t maxLen);
 static int readChar(wchar_t *chr);
 static int nextChar(wchar_t *chr);
@@ -71,8 +73,75 @@ static size_t byteBufSize;
 static size_t fieldCnt;
 static size_t remFieldCnt;
 static ParserState state;
+static bool countingFields;
 
 int csvOpen(const wchar_t *path, size_t _fieldCnt, int header)
+{
+    assert(path);
+    assert(_fieldCnt);
+
+    if (openFile(path, _fieldCnt))
+    {
+        /* TODO error */
+        goto fail_file;
+    }
+    if (header && readHeader())
+    {
+        /* TODO error */
+        goto fail_header;
+    }
+
+    return 0;
+
+fail_header:
+    csvClose();
+fail_file:
+    return 1;
+}
+
+int csvOpenVariable(const wchar_t *path,
+                    size_t minFieldCnt,
+                    size_t maxFieldCnt,
+                    size_t *headerFieldCnt)
+{
+    size_t cnt;
+
+    assert(path);
+    assert(minFieldCnt);
+    assert(minFieldCnt <= maxFieldCnt);
+    assert(headerFieldCnt);
+
+    if (openFile(path, maxFieldCnt))
+    {
+        /* TODO error */
+        goto fail_file;
+    }
+    if (countHeaderFields(&cnt))
+    {
+        /* TODO error */
+        goto fail_header;
+    }
+    if (cnt < minFieldCnt)
+    {
+        /* TODO error */
+        goto fail_header;
+    }
+
+    /* The header determines the number of fields of all following records. */
+
+    fieldCnt = cnt;
+    remFieldCnt = fieldCnt;
+    *headerFieldCnt = cnt;
+
+    return 0;
+
+fail_header:
+    csvClose();
+fail_file:
+    return 1;
+}
+
+int openFile(const wchar_t *path, size_t _fieldCnt)
 {
     assert(path);
     assert(_fieldCnt);
@@ -118,15 +187,9 @@ int csvOpen(const wchar_t *path, size_t _fieldCnt, int header)
         /* TODO error */
         goto fail_bytes;
     }
-    if (header && readHeader())
-    {
-        /* TODO error */
-        goto fail_header;
-    }
 
     return 0;
 
-fail_header:
 fail_bytes:
     freeMem(byteBuf);
 fail_alloc:
@@ -379,6 +442,42 @@ int readHeader(void)
     return 0;
 }
 
+int countHeaderFields(size_t *cnt)
+{
+    wchar_t chr[2];
+    int res;
+
+    assert(cnt);
+    assert(BUFLEN(chr) == 2);
+
+    /* Read fields until the end of the first record. While counting, the
+    ** record is allowed to end before all fieldCnt fields were read, so
+    ** fieldCnt merely acts as an upper limit.
+    */
+
+    *cnt = 0;
+    countingFields = true;
+
+    do
+    {
+        while ((res = readChar(chr)) > 0)
+            ;
+
+        if (res < 0)
+        {
+            /* TODO error */
+            countingFields = false;
+            return 1;
+        }
+
+        (*cnt)++;
+    }
+    while (state != ST_EOF && remFieldCnt != fieldCnt);
+
+    countingFields = false;
+    return 0;
+}
+
 int csvWriteString(const wchar_t *str)
 {
     return writeValue(str, true);
@@ -566,7 +665,7 @@ int readChar(wchar_t *chr)
                 /* TODO error */
                 goto fail_syntax;
             }
-            if (remFieldCnt)
+            if (remFieldCnt && !countingFields)
             {
                 /* TODO error */
                 goto fail_syntax;
@@ -633,7 +732,7 @@ int readChar(wchar_t *chr)
         remFieldCnt--;
     case ST_UNQUOTED:
     case ST_QUOTE:
-        if (remFieldCnt)
+        if (remFieldCnt && !countingFields)
         {
             /* TODO error */
             goto fail_syntax;
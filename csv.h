@@ -31,6 +31,10 @@ extern "C" {
 #endif
 
 int csvOpen(const wchar_t *path, size_t fieldCnt, int header);
+int csvOpenVariable(const wchar_t *path,
+                    size_t minFieldCnt,
+                    size_t maxFieldCnt,
+                    size_t *headerFieldCnt);
 int csvCreate(const wchar_t *path, size_t fieldCnt);
 int csvFlush(void);
 void csvClose(void);
@@ -17,6 +17,8 @@ along with this program. If not, see <http://www.gnu.org/licenses/>.
 */
 #include "base.h"
 #include "event_map.h"
+#include "glob.h"
+#include "scope.h"
 #include "match.h"
 #include "mem.h"
 #include "plugin.h"
@@ -42,13 +44,46 @@ along with this program. If not, see <http://www.gnu.org/licenses/>.
 /** TODO doc */
 #define ERR_MSG_INVALID_REGEX L"The value is not a valid regular expression."
 
+/** TODO doc */
+#define ERR_MSG_INVALID_GLOB L"The value is not a valid glob list."
+
+/** TODO doc */
+#define ERR_MSG_INVALID_SCOPE L"The value is not a valid directory."
+
+/** TODO doc */
+#define ERR_MSG_SLOW_REGEX L"The value may take exponential time to match."
+
+/** The delay after the last change of the regex before it's validated. */
+#define VALIDATE_DELAY_IN_MS 300
+
+/** The timer which starts the validation of the regex. */
+#define IDT_VALIDATE_REGEX 1
+
+/** Posted to the dialog by the thread which compiled the regex. */
+#define WM_REGEX_VALIDATED (WM_APP + 1)
+
 typedef wchar_t* (*ValidateProc)(const wchar_t*);
 
+/* A regex which is compiled in the background while the user is typing.
+** RegexValidation::seq is the value of Dialog::regexSeq when the validation
+** was started.
+*/
+
+typedef struct
+{
+    HWND dlg;
+    unsigned long seq;
+    Matcher *matcher;
+    wchar_t regex[];
+} RegexValidation;
+
 typedef struct
 {
     HDWP hdwp;
     LONG offsName;
     LONG offsRegex;
+    LONG offsGlob;
+    LONG offsScope;
     LONG offsCmd;
 } LayoutDlgData;
 
@@ -78,12 +113,21 @@ typedef struct
     HWND handle;
     InputCtrl ctrlName;
     InputCtrl ctrlRegex;
+    InputCtrl ctrlGlob;
+    InputCtrl ctrlScope;
     InputCtrl ctrlCmd;
     InputCtrl *ctrls;
     HWND lblEvent;
     HWND cbEvent;
+    HWND cbTarget;
+    HWND cbCoalesce;
+    HWND cbRateLimit;
+    HWND edRateWindow;
+    HWND cbPriority;
     HWND btnEnabled;
     HWND btnForeground;
+    HWND btnStop;
+    HWND btnCanonical;
     HWND btnApply;
     HWND btnCancel;
     HBRUSH errBrush;
@@ -94,6 +138,11 @@ typedef struct
     LONG clientWidth;
     LONG height;
     Rule *rule;
+    Matcher *matcher;
+    GlobMatcher *globMatcher;
+    unsigned long regexSeq;
+    RegexValidation *validation;
+    HANDLE validationThread;
     bool initialized;
 } Dialog;
 
@@ -104,6 +153,8 @@ static void onSize(WORD clientWidth);
 static void onGetMinMaxInfo(MINMAXINFO *mmi);
 static LRESULT onCtlColorEdit(HWND handle, UINT msg, WPARAM wp, LPARAM lp);
 static void onEnChange(WPARAM wp, LPARAM lp);
+static void onValidateTimer(void);
+static void onRegexValidated(RegexValidation *validation);
 static void onSelChange(void);
 static void onBnClicked(void);
 static void onClose(void);
@@ -114,14 +165,21 @@ static bool createErrorFont(void);
 static void layoutDlg(void);
 static BOOL CALLBACK layoutDlgProc(HWND wnd, LPARAM lp);
 static int validateChanges(void);
+static void markCtrlInvalid(InputCtrl *ctrl, const wchar_t *errMsg);
 static bool extractCtrlContents(InputCtrl *ctrl);
 static void applyChanges(void);
+static bool validateRateWindow(void);
+static void updateRateWindow(void);
 static bool validateAndApplyChanges(void);
 static void setChangesApplicable(bool applicable);
 static bool areChangesApplicable(void);
 static wchar_t* validateName(const wchar_t *val);
 static wchar_t* validateRegex(const wchar_t *val);
+static wchar_t* validateGlob(const wchar_t *val);
+static wchar_t* validateScope(const wchar_t *val);
 static wchar_t* validateCmd(const wchar_t *val);
+static DWORD WINAPI validateRegexProc(LPVOID param);
+static void freeRegexValidation(RegexValidation *validation);
 
 static Dialog *dlg;
 
@@ -139,11 +197,18 @@ int openEditDlg(HWND parent, Rule *rule)
     }
 
     dlg->rule = rule;
+    dlg->matcher = NULL;
+    dlg->globMatcher = NULL;
+    dlg->regexSeq = 0;
+    dlg->validation = NULL;
+    dlg->validationThread = NULL;
     dlg->initialized = false;
 
     res = DialogBoxW(getPluginInstance(), MAKEINTRESOURCE(IDD_EDIT),
                      parent, dlgProc);
 
+    freeMatcher(dlg->matcher);
+    freeGlob(dlg->globMatcher);
     freeMem(dlg);
     dlg = NULL;
 
@@ -183,6 +248,18 @@ INT_PTR CALLBACK dlgProc(HWND handle, UINT msg, WPARAM wp, LPARAM lp)
         onClose();
         DLGPROC_RESULT(handle, 0);
 
+    case WM_TIMER:
+        if (wp == IDT_VALIDATE_REGEX)
+        {
+            onValidateTimer();
+            DLGPROC_RESULT(handle, 0);
+        }
+        break;
+
+    case WM_REGEX_VALIDATED:
+        onRegexValidated((RegexValidation*) lp);
+        DLGPROC_RESULT(handle, 0);
+
     case WM_SYSCOMMAND:
         if (wp == SC_CLOSE)
         {
@@ -251,20 +328,33 @@ void onInitDlg(HWND handle)
 
     dlg->ctrls = &dlg->ctrlName;
     dlg->ctrlName.next = &dlg->ctrlRegex;
-    dlg->ctrlRegex.next = &dlg->ctrlCmd;
+    dlg->ctrlRegex.next = &dlg->ctrlGlob;
+    dlg->ctrlGlob.next = &dlg->ctrlScope;
+    dlg->ctrlScope.next = &dlg->ctrlCmd;
     dlg->ctrlCmd.next = NULL;
 
     initCtrl(&dlg->ctrlName, IDC_ST_NAME, IDC_ED_NAME, IDC_ST_NAME_ERROR,
              &rule->name, validateName);
     initCtrl(&dlg->ctrlRegex, IDC_ST_REGEX, IDC_ED_REGEX, IDC_ST_REGEX_ERROR,
              &rule->regex, validateRegex);
+    initCtrl(&dlg->ctrlGlob, IDC_ST_GLOB, IDC_ED_GLOB, IDC_ST_GLOB_ERROR,
+             &rule->glob, validateGlob);
+    initCtrl(&dlg->ctrlScope, IDC_ST_SCOPE, IDC_ED_SCOPE, IDC_ST_SCOPE_ERROR,
+             &rule->scope, validateScope);
     initCtrl(&dlg->ctrlCmd, IDC_ST_COMMAND, IDC_ED_COMMAND,
              IDC_ST_COMMAND_ERROR, &rule->cmd, validateCmd);
 
     dlg->lblEvent = GetDlgItem(handle, IDC_ST_EVENT);
     dlg->cbEvent = GetDlgItem(handle, IDC_CB_EVENT);
+    dlg->cbTarget = GetDlgItem(handle, IDC_CB_TARGET);
+    dlg->cbCoalesce = GetDlgItem(handle, IDC_CB_COALESCE);
+    dlg->cbRateLimit = GetDlgItem(handle, IDC_CB_RATE_LIMIT);
+    dlg->edRateWindow = GetDlgItem(handle, IDC_ED_RATE_WINDOW);
+    dlg->cbPriority = GetDlgItem(handle, IDC_CB_PRIORITY);
     dlg->btnEnabled = GetDlgItem(handle, IDC_BT_ENABLED);
     dlg->btnForeground = GetDlgItem(handle, IDC_BT_FOREGROUND);
+    dlg->btnStop = GetDlgItem(handle, IDC_BT_STOP);
+    dlg->btnCanonical = GetDlgItem(handle, IDC_BT_CANONICAL);
     dlg->btnApply = GetDlgItem(handle, IDC_BT_APPLY);
     dlg->btnCancel = GetDlgItem(handle, IDCANCEL);
 
@@ -287,8 +377,32 @@ void onInitDlg(HWND handle)
         EnableWindow(dlg->cbEvent, FALSE);
     }
 
+    for (ii = 0; ii < MATCH_TARGET_CNT; ii++)
+        ComboBox_AddString(dlg->cbTarget, getMatchTargetName(ii));
+
+    ComboBox_SetCurSel(dlg->cbTarget, rule->target);
+
+    for (ii = 0; ii < COALESCE_CNT; ii++)
+        ComboBox_AddString(dlg->cbCoalesce, getCoalescePolicyName(ii));
+
+    ComboBox_SetCurSel(dlg->cbCoalesce, rule->coalesce);
+
+    for (ii = 0; ii < RATE_LIMIT_CNT; ii++)
+        ComboBox_AddString(dlg->cbRateLimit, getRateLimitName(ii));
+
+    ComboBox_SetCurSel(dlg->cbRateLimit, rule->rateLimit);
+    SetDlgItemInt(handle, IDC_ED_RATE_WINDOW, rule->rateWindow, FALSE);
+    updateRateWindow();
+
+    for (ii = 0; ii < PRIORITY_CNT; ii++)
+        ComboBox_AddString(dlg->cbPriority, getPriorityName(ii));
+
+    ComboBox_SetCurSel(dlg->cbPriority, rule->priority);
+
     Button_SetCheck(dlg->btnEnabled, rule->enabled);
     Button_SetCheck(dlg->btnForeground, !rule->background);
+    Button_SetCheck(dlg->btnStop, rule->stop);
+    Button_SetCheck(dlg->btnCanonical, rule->canonical);
 
     setChangesApplicable(false);
 
@@ -316,12 +430,33 @@ fail_err_brush:
 void onDestroy(void)
 {
     InputCtrl *ctrl;
+    MSG msg;
 
     if (dlg->initialized)
     {
         for (ctrl = dlg->ctrls; ctrl; ctrl = ctrl->next)
             freeStr(ctrl->value);
 
+        /* The running validation is waited for, so its result is either
+        ** posted by now or never will be. The posted ones are freed here.
+        */
+
+        KillTimer(dlg->handle, IDT_VALIDATE_REGEX);
+
+        if (dlg->validationThread)
+        {
+            WaitForSingleObject(dlg->validationThread, INFINITE);
+            CloseHandle(dlg->validationThread);
+        }
+
+        while (PeekMessageW(&msg, dlg->handle, WM_REGEX_VALIDATED,
+                            WM_REGEX_VALIDATED, PM_REMOVE))
+        {
+            freeRegexValidation((RegexValidation*) msg.lParam);
+        }
+
+        freeRegexValidation(dlg->validation);
+
         DeleteObject(dlg->errFont);
         DeleteObject(dlg->errBrush);
     }
@@ -365,6 +500,8 @@ void onSize(WORD clientWidth)
     setWndPosDeferred((SetWindowPosArgs[]) {
         sizeWnd(dlg->ctrlName.handle, inputWidth, inputHeight),
         sizeWnd(dlg->ctrlRegex.handle, inputWidth, inputHeight),
+        sizeWnd(dlg->ctrlGlob.handle, inputWidth, inputHeight),
+        sizeWnd(dlg->ctrlScope.handle, inputWidth, inputHeight),
         sizeWnd(dlg->ctrlCmd.handle, inputWidth, inputHeight),
         positionWnd(dlg->btnApply, btnApplyLeft, rcApply.top),
         positionWnd(dlg->btnCancel, btnCancelLeft, rcApply.top),
@@ -435,14 +572,107 @@ void onEnChange(WPARAM wp, LPARAM lp)
         }
     }
 
+    /* The regex is validated in the background once the user stops typing.
+    ** Every change invalidates the validations started so far.
+    */
+
+    if (ctrl == &dlg->ctrlRegex)
+    {
+        dlg->regexSeq++;
+
+        if (!SetTimer(dlg->handle, IDT_VALIDATE_REGEX, VALIDATE_DELAY_IN_MS,
+                      NULL))
+        {
+            /* TODO error */
+        }
+    }
+
     dlg->applied = false;
 
     if (!dlg->invalidCnt && !areChangesApplicable())
         setChangesApplicable(true);
 }
 
+void onValidateTimer(void)
+{
+    RegexValidation *validation;
+    HANDLE thread;
+    int len;
+
+    /* Only one validation runs at a time. While it does, the timer keeps
+    ** running, so the regex is validated once it has finished.
+    */
+
+    if (dlg->validationThread)
+    {
+        if (WaitForSingleObject(dlg->validationThread, 0) == WAIT_TIMEOUT)
+            return;
+
+        CloseHandle(dlg->validationThread);
+        dlg->validationThread = NULL;
+    }
+
+    KillTimer(dlg->handle, IDT_VALIDATE_REGEX);
+
+    /* Failing to start the validation is no problem, the regex is validated
+    ** again once the changes are applied.
+    */
+
+    len = GetWindowTextLengthW(dlg->ctrlRegex.handle);
+
+    if (!(validation = allocMem(sizeof *validation
+                                + (len + 1) * sizeof *validation->regex)))
+    {
+        /* TODO error */
+        return;
+    }
+
+    GetWindowTextW(dlg->ctrlRegex.handle, validation->regex, len + 1);
+    validation->dlg = dlg->handle;
+    validation->seq = dlg->regexSeq;
+    validation->matcher = NULL;
+
+    if (!(thread = CreateThread(NULL, 0, validateRegexProc, validation, 0,
+                                NULL)))
+    {
+        /* TODO error */
+        freeMem(validation);
+        return;
+    }
+
+    dlg->validationThread = thread;
+}
+
+void onRegexValidated(RegexValidation *validation)
+{
+    /* The regex was changed or the changes were applied in the meantime. */
+
+    if (validation->seq != dlg->regexSeq
+        || dlg->ctrlRegex.status != VAL_CHANGED)
+    {
+        freeRegexValidation(validation);
+        return;
+    }
+
+    if (!validation->matcher)
+    {
+        freeRegexValidation(validation);
+        markCtrlInvalid(&dlg->ctrlRegex, ERR_MSG_INVALID_REGEX);
+        layoutDlg();
+        setChangesApplicable(false);
+        return;
+    }
+
+    /* The matcher is kept until the changes are applied. */
+
+    freeRegexValidation(dlg->validation);
+    dlg->validation = validation;
+}
+
 void onSelChange(void)
 {
+    updateRateWindow();
+
     dlg->applied = false;
 
     if (!dlg->invalidCnt && !areChangesApplicable())
@@ -584,6 +814,8 @@ void layoutDlg(void)
 
     data.offsName = INPUT_CTRL_OFFSET(dlg->ctrlName);
     data.offsRegex = INPUT_CTRL_OFFSET(dlg->ctrlRegex);
+    data.offsGlob = INPUT_CTRL_OFFSET(dlg->ctrlGlob);
+    data.offsScope = INPUT_CTRL_OFFSET(dlg->ctrlScope);
     data.offsCmd = INPUT_CTRL_OFFSET(dlg->ctrlCmd);
 
 #undef INPUT_CTRL_OFFSET
@@ -595,7 +827,8 @@ void layoutDlg(void)
     GetWindowRect(dlg->handle, &rc);
     dlgWidth = rc.right - rc.left;
     dlgHeight = rc.bottom - rc.top;
-    dlg->height = dlgHeight + data.offsName + data.offsRegex + data.offsCmd;
+    dlg->height = dlgHeight + data.offsName + data.offsRegex + data.offsGlob
+                  + data.offsScope + data.offsCmd;
 
     SetWindowPos(dlg->handle,
                  NULL,
@@ -659,16 +892,40 @@ BOOL CALLBACK layoutDlgProc(HWND wnd, LPARAM lp)
     case IDC_ST_REGEX_ERROR:
         rc.top += data->offsName;
         break;
+    case IDC_ST_TARGET:
+    case IDC_CB_TARGET:
+    case IDC_ST_GLOB:
+    case IDC_ED_GLOB:
+    case IDC_ST_GLOB_ERROR:
+        rc.top += data->offsName + data->offsRegex;
+        break;
+    case IDC_ST_SCOPE:
+    case IDC_ED_SCOPE:
+    case IDC_ST_SCOPE_ERROR:
+        rc.top += data->offsName + data->offsRegex + data->offsGlob;
+        break;
     case IDC_ST_COMMAND:
     case IDC_ED_COMMAND:
     case IDC_ST_COMMAND_ERROR:
-        rc.top += data->offsName + data->offsRegex;
+        rc.top += data->offsName + data->offsRegex + data->offsGlob
+                  + data->offsScope;
         break;
+    case IDC_ST_COALESCE:
+    case IDC_CB_COALESCE:
+    case IDC_ST_RATE_LIMIT:
+    case IDC_CB_RATE_LIMIT:
+    case IDC_ST_RATE_WINDOW:
+    case IDC_ED_RATE_WINDOW:
+    case IDC_ST_PRIORITY:
+    case IDC_CB_PRIORITY:
     case IDC_BT_ENABLED:
     case IDC_BT_FOREGROUND:
+    case IDC_BT_STOP:
+    case IDC_BT_CANONICAL:
     case IDC_BT_APPLY:
     case IDCANCEL:
-        rc.top += data->offsName + data->offsRegex + data->offsCmd;
+        rc.top += data->offsName + data->offsRegex + data->offsGlob
+                  + data->offsScope + data->offsCmd;
         break;
     }
 
@@ -695,7 +952,6 @@ int validateChanges(void)
     InputCtrl *ctrl;
     InputCtrl *prev;
     wchar_t *errMsg;
-    wchar_t buf[1024];
 
     assert(!dlg->invalidCnt);
 
@@ -730,18 +986,7 @@ int validateChanges(void)
             }
 
             if ((errMsg = ctrl->validateProc(ctrl->value)))
-            {
-                freeStr(ctrl->value);
-                ctrl->value = NULL;
-                ctrl->status  = VAL_INVALID;
-                ctrl->updated = false;
-
-                StringCbCopyW(buf, sizeof buf, L"^ ");
-                StringCbCatW(buf, sizeof buf, errMsg);
-                SetWindowTextW(ctrl->labelError, buf);
-                ShowWindow(ctrl->labelError, SW_SHOW);
-                dlg->invalidCnt++;
-            }
+                markCtrlInvalid(ctrl, errMsg);
             else
                 ctrl->status = VAL_VALID;
         }
@@ -753,6 +998,22 @@ int validateChanges(void)
     return dlg->invalidCnt > 0;
 }
 
+void markCtrlInvalid(InputCtrl *ctrl, const wchar_t *errMsg)
+{
+    wchar_t buf[1024];
+
+    freeStr(ctrl->value);
+    ctrl->value = NULL;
+    ctrl->status  = VAL_INVALID;
+    ctrl->updated = false;
+
+    StringCbCopyW(buf, sizeof buf, L"^ ");
+    StringCbCatW(buf, sizeof buf, errMsg);
+    SetWindowTextW(ctrl->labelError, buf);
+    ShowWindow(ctrl->labelError, SW_SHOW);
+    dlg->invalidCnt++;
+}
+
 bool extractCtrlContents(InputCtrl *ctrl)
 {
     unsigned int len;
@@ -789,6 +1050,28 @@ void applyChanges(void)
 
     rule = dlg->rule;
 
+    /* The matcher compiled during the validation belongs to the regex which
+    ** is about to be applied so there's no need to compile it again.
+    */
+
+    if (dlg->ctrlRegex.value)
+    {
+        assert(dlg->matcher);
+
+        freeMatcher(rule->matcher);
+        rule->matcher = dlg->matcher;
+        dlg->matcher = NULL;
+    }
+
+    /* Same for the glob list, whose matcher is NULL if the list is empty. */
+
+    if (dlg->ctrlGlob.value)
+    {
+        freeGlob(rule->globMatcher);
+        rule->globMatcher = dlg->globMatcher;
+        dlg->globMatcher = NULL;
+    }
+
     for (ctrl = dlg->ctrls; ctrl; ctrl = ctrl->next)
     {
         if (ctrl->value)
@@ -803,8 +1086,22 @@ void applyChanges(void)
     if (IsWindowEnabled(dlg->cbEvent))
         rule->event = eventMap[ComboBox_GetCurSel(dlg->cbEvent)].event;
 
+    rule->target = (MatchTarget) ComboBox_GetCurSel(dlg->cbTarget);
+    rule->coalesce = (CoalescePolicy) ComboBox_GetCurSel(dlg->cbCoalesce);
+    rule->rateLimit = (RateLimit) ComboBox_GetCurSel(dlg->cbRateLimit);
+    rule->priority = (Priority) ComboBox_GetCurSel(dlg->cbPriority);
+
+    /* The window is only validated if the rule is rate limited. */
+
+    if (rule->rateLimit != RATE_LIMIT_NONE)
+    {
+        rule->rateWindow = GetDlgItemInt(dlg->handle, IDC_ED_RATE_WINDOW, NULL,
+                                         FALSE);
+    }
     rule->enabled = Button_GetCheck(dlg->btnEnabled) == BST_CHECKED;
     rule->background = Button_GetCheck(dlg->btnForeground) != BST_CHECKED;
+    rule->stop = Button_GetCheck(dlg->btnStop) == BST_CHECKED;
+    rule->canonical = Button_GetCheck(dlg->btnCanonical) == BST_CHECKED;
 }
 
 bool validateAndApplyChanges(void)
@@ -827,11 +1124,48 @@ bool validateAndApplyChanges(void)
         return false;
     }
 
+    if (!validateRateWindow())
+        return false;
+
     applyChanges();
 
     return true;
 }
 
+bool validateRateWindow(void)
+{
+    BOOL translated;
+    UINT window;
+
+    /* The edit control only accepts digits, but it may still be empty or hold
+    ** a number which is too large.
+    */
+
+    if (ComboBox_GetCurSel(dlg->cbRateLimit) == RATE_LIMIT_NONE)
+        return true;
+
+    window = GetDlgItemInt(dlg->handle, IDC_ED_RATE_WINDOW, &translated,
+                           FALSE);
+
+    if (!translated || !window || window > MAX_RATE_WINDOW_IN_MS)
+    {
+        errorMsgBox(dlg->handle,
+                    L"The rate window must be between 1 and %u ms.",
+                    MAX_RATE_WINDOW_IN_MS);
+        return false;
+    }
+
+    return true;
+}
+
+void updateRateWindow(void)
+{
+    /* The window only matters if the rule is rate limited. */
+
+    EnableWindow(dlg->edRateWindow,
+                 ComboBox_GetCurSel(dlg->cbRateLimit) != RATE_LIMIT_NONE);
+}
+
 void setChangesApplicable(bool applicable)
 {
     EnableWindow(dlg->btnApply, applicable);
@@ -860,7 +1194,69 @@ wchar_t* validateRegex(const wchar_t *val)
 {
     assert(val);
 
-    return !isValidRegex(val) ? ERR_MSG_INVALID_REGEX : NULL;
+    /* Keep the compiled matcher, it's handed over to the rule once the
+    ** changes are applied. The regex was most likely compiled in the
+    ** background already.
+    */
+
+    freeMatcher(dlg->matcher);
+    dlg->matcher = NULL;
+
+    if (dlg->validation && !wcscmp(dlg->validation->regex, val))
+    {
+        dlg->matcher = dlg->validation->matcher;
+        dlg->validation->matcher = NULL;
+    }
+
+    freeRegexValidation(dlg->validation);
+    dlg->validation = NULL;
+
+    if (!dlg->matcher && !(dlg->matcher = compileMatcher(val)))
+        return ERR_MSG_INVALID_REGEX;
+
+    /* Slow regexes are disabled once they take too long to match, so the
+    ** user is asked to reconsider them beforehand.
+    */
+
+    if (isExponentialRegex(dlg->matcher, val)
+        && msgBox(MB_YESNO | MB_ICONWARNING,
+                  dlg->handle,
+                  L"Slow regular expression",
+                  L"The regular expression repeats a group which contains a "
+                  L"repetition itself, e.g. (a+)*. Matching it may take "
+                  L"exponential time, in which case the rule is disabled. Do "
+                  L"you wish to keep it anyway?") != IDYES)
+    {
+        return ERR_MSG_SLOW_REGEX;
+    }
+
+    return NULL;
+}
+
+wchar_t* validateGlob(const wchar_t *val)
+{
+    assert(val);
+
+    /* An empty glob list means the rule is matched by its regex. */
+
+    freeGlob(dlg->globMatcher);
+    dlg->globMatcher = NULL;
+
+    if (*val == L'\0')
+        return NULL;
+
+    dlg->globMatcher = compileGlob(val);
+
+    return !dlg->globMatcher ? ERR_MSG_INVALID_GLOB : NULL;
+}
+
+wchar_t* validateScope(const wchar_t *val)
+{
+    assert(val);
+
+    /* An empty scope means the rule applies to all files. */
+
+    return !isValidScope(val) ? ERR_MSG_INVALID_SCOPE : NULL;
 }
 
 wchar_t* validateCmd(const wchar_t *val)
@@ -876,3 +1272,30 @@ wchar_t* validateCmd(const wchar_t *val)
 
     return NULL;
 }
+
+DWORD WINAPI validateRegexProc(LPVOID param)
+{
+    RegexValidation *validation;
+
+    validation = param;
+    validation->matcher = compileMatcher(validation->regex);
+
+    /* The dialog waits for the thread before it's destroyed. */
+
+    if (!PostMessageW(validation->dlg, WM_REGEX_VALIDATED, 0,
+                      (LPARAM) validation))
+    {
+        freeRegexValidation(validation);
+    }
+
+    return 0;
+}
+
+void freeRegexValidation(RegexValidation *validation)
+{
+    if (!validation)
+        return;
+
+    freeMatcher(validation->matcher);
+    freeMem(validation);
+}
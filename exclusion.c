@@ -0,0 +1,542 @@
+/*
+This file is part of NppEventExec
+Copyright (C) 2016-2017 Mihail Ivanchev
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "base.h"
+#include "mem.h"
+#include "util.h"
+#include "hash.h"
+#include "path_scan.h"
+#include "exclusion.h"
+#include <math.h>
+
+/** The Bloom filter has at least this many bits per prefix. */
+#define BITS_PER_PREFIX 10
+
+/** The number of bits of the Bloom filter checked per prefix. */
+#define PROBE_CNT 7
+
+/** The exact set has at least this many slots per prefix. */
+#define SLOTS_PER_PREFIX 2
+
+/** Exclusion files larger than this are rejected. */
+#define MAX_FILE_SIZE (64 * 1024 * 1024)
+
+typedef struct
+{
+    const wchar_t *str;
+    size_t len;
+    size_t hash;
+} Prefix;
+
+static wchar_t* readText(const wchar_t *path);
+static int addPrefix(const wchar_t *line, const wchar_t *end, wchar_t **dest);
+static size_t mixHash(size_t hash);
+static bool mayContain(size_t hash);
+static bool contains(const wchar_t *path, const wchar_t *end, size_t hash);
+static bool isSamePrefix(const Prefix *prefix,
+                         const wchar_t *path,
+                         const wchar_t *end);
+
+/* The prefixes are folded, their components are joined by slashes and they
+** are stored in buf. The exact set slots is an open addressing hash set with
+** slotMask + 1 slots, the Bloom filter bits has bitMask + 1 bits.
+*/
+
+static wchar_t *buf;
+static size_t bufLen;
+static Prefix *slots;
+static size_t slotMask;
+static unsigned char *bits;
+static size_t bitMask;
+static size_t prefixCnt;
+static unsigned long long checkCnt;
+static unsigned long long excludedCnt;
+static unsigned long long lookupCnt;
+static unsigned long long falsePositiveCnt;
+
+int loadExclusions(const wchar_t *path)
+{
+    wchar_t *text;
+    wchar_t *line;
+    wchar_t *end;
+    wchar_t *next;
+    wchar_t *dest;
+    size_t lineCnt;
+    size_t slotCnt;
+    size_t bitCnt;
+    size_t ii;
+
+    assert(path);
+
+    clearExclusions();
+
+    if (GetFileAttributesW(path) == INVALID_FILE_ATTRIBUTES
+        && GetLastError() == ERROR_FILE_NOT_FOUND)
+    {
+        return 0;
+    }
+
+    if (!(text = readText(path)))
+    {
+        /* TODO error */
+        goto fail_text;
+    }
+
+    lineCnt = 1;
+
+    for (line = text; *line; line++)
+        lineCnt += *line == L'\n';
+
+    if (lineCnt > SIZE_MAX / SLOTS_PER_PREFIX / sizeof(Prefix)
+        || lineCnt > SIZE_MAX / BITS_PER_PREFIX)
+    {
+        /* TODO error */
+        goto fail_too_many_lines;
+    }
+
+    for (slotCnt = 1; slotCnt < SLOTS_PER_PREFIX * lineCnt; slotCnt <<= 1)
+        ;
+    for (bitCnt = CHAR_BIT; bitCnt < BITS_PER_PREFIX * lineCnt; bitCnt <<= 1)
+        ;
+
+    /* The folded prefixes are never longer than the text. */
+
+    bufLen = wcslen(text) + 1;
+
+    if (!(buf = allocStr(bufLen)))
+    {
+        /* TODO error */
+        goto fail_buf;
+    }
+    if (!(slots = allocMem(slotCnt * sizeof(Prefix))))
+    {
+        /* TODO error */
+        goto fail_slots;
+    }
+    if (!(bits = allocMem(bitCnt / CHAR_BIT)))
+    {
+        /* TODO error */
+        goto fail_bits;
+    }
+
+    for (ii = 0; ii < slotCnt; ii++)
+        slots[ii].str = NULL;
+
+    ZeroMemory(bits, bitCnt / CHAR_BIT);
+
+    slotMask = slotCnt - 1;
+    bitMask = bitCnt - 1;
+    dest = buf;
+
+    for (line = text; line; line = next)
+    {
+        if ((end = wcschr(line, L'\n')))
+        {
+            next = end + 1;
+        }
+        else
+        {
+            end = line + wcslen(line);
+            next = NULL;
+        }
+
+        while (line < end && IS_SPACE(*line))
+            line++;
+        while (end > line && IS_SPACE(end[-1]))
+            end--;
+
+        if (line == end || *line == L'#')
+            continue;
+
+        if (addPrefix(line, end, &dest))
+        {
+            /* TODO error */
+            goto fail_prefix;
+        }
+    }
+
+    freeStr(text);
+
+    return 0;
+
+fail_prefix:
+    freeMem(bits);
+    bits = NULL;
+fail_bits:
+    freeMem(slots);
+    slots = NULL;
+fail_slots:
+    freeStr(buf);
+    buf = NULL;
+fail_buf:
+fail_too_many_lines:
+    freeStr(text);
+fail_text:
+    prefixCnt = 0;
+    return 1;
+}
+
+void clearExclusions(void)
+{
+    freeMem(bits);
+    freeMem(slots);
+    freeStr(buf);
+
+    bits = NULL;
+    slots = NULL;
+    buf = NULL;
+    prefixCnt = 0;
+}
+
+int isPathExcluded(const wchar_t *path)
+{
+    const wchar_t *pos;
+    const wchar_t *sep;
+    const wchar_t *end;
+    size_t hash;
+    bool first;
+
+    assert(path);
+
+    if (!prefixCnt)
+        return 0;
+
+    checkCnt++;
+
+    /* The prefixes of the path are hashed incrementally, the same way the
+    ** prefixes of the list were. Only the prefixes which pass the Bloom
+    ** filter are looked up in the exact set.
+    */
+
+    hash = FNV_OFFSET_BASIS;
+    first = true;
+    end = path + wcslen(path);
+
+    for (pos = path; pos < end; pos = sep + 1)
+    {
+        sep = findSeparator(pos, end);
+
+        if (sep == pos)
+            continue;
+
+        if (!first)
+            hash = FNV_STEP(hash, L'/');
+
+        first = false;
+        hash = hashFoldedRange(hash, pos, sep - pos);
+
+        lookupCnt++;
+
+        if (!mayContain(hash))
+            continue;
+
+        if (contains(path, sep, hash))
+        {
+            excludedCnt++;
+            return 1;
+        }
+
+        falsePositiveCnt++;
+    }
+
+    return 0;
+}
+
+void getExclusionStats(ExclusionStats *stats)
+{
+    double fill;
+
+    assert(stats);
+
+    stats->prefixCnt = prefixCnt;
+    stats->memSize = 0;
+    stats->expectedFpRate = 0.0;
+
+    if (prefixCnt)
+    {
+        stats->memSize = (bitMask + 1) / CHAR_BIT
+                         + (slotMask + 1) * sizeof(Prefix)
+                         + bufLen * sizeof(wchar_t);
+
+        /* The standard estimate (1 - e^(-kn/m))^k. */
+
+        fill = 1.0 - exp(-(double) PROBE_CNT * prefixCnt / (bitMask + 1));
+        stats->expectedFpRate = pow(fill, PROBE_CNT);
+    }
+
+    stats->checkCnt = checkCnt;
+    stats->excludedCnt = excludedCnt;
+    stats->lookupCnt = lookupCnt;
+    stats->falsePositiveCnt = falsePositiveCnt;
+}
+
+wchar_t* readText(const wchar_t *path)
+{
+    HANDLE file;
+    LARGE_INTEGER size;
+    char *bytes;
+    char *start;
+    wchar_t *text;
+    DWORD byteCnt;
+    int charCnt;
+
+    file = CreateFileW(path,
+                       GENERIC_READ,
+                       FILE_SHARE_READ,
+                       NULL,
+                       OPEN_EXISTING,
+                       FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN,
+                       NULL);
+
+    if (file == INVALID_HANDLE_VALUE)
+    {
+        /* TODO error */
+        goto fail_file;
+    }
+    if (!GetFileSizeEx(file, &size))
+    {
+        /* TODO error */
+        goto fail_size;
+    }
+    if (size.QuadPart > MAX_FILE_SIZE)
+    {
+        /* TODO error */
+        goto fail_size;
+    }
+    if (!(bytes = allocMem((size_t) size.QuadPart + 1)))
+    {
+        /* TODO error */
+        goto fail_bytes;
+    }
+    if (!ReadFile(file, bytes, (DWORD) size.QuadPart, &byteCnt, NULL)
+        || byteCnt != size.QuadPart)
+    {
+        /* TODO error */
+        goto fail_read;
+    }
+
+    /* Skip the byte order mark. */
+
+    start = bytes;
+
+    if (byteCnt >= 3 && !memcmp(bytes, "\xEF\xBB\xBF", 3))
+    {
+        start += 3;
+        byteCnt -= 3;
+    }
+
+    charCnt = 0;
+
+    if (byteCnt && !(charCnt = MultiByteToWideChar(CP_UTF8,
+                                                   MB_ERR_INVALID_CHARS,
+                                                   start,
+                                                   (int) byteCnt,
+                                                   NULL,
+                                                   0)))
+    {
+        /* TODO error */
+        goto fail_decode;
+    }
+    if (!(text = allocStr(charCnt + 1)))
+    {
+        /* TODO error */
+        goto fail_text;
+    }
+    if (byteCnt && !MultiByteToWideChar(CP_UTF8,
+                                        MB_ERR_INVALID_CHARS,
+                                        start,
+                                        (int) byteCnt,
+                                        text,
+                                        charCnt))
+    {
+        /* TODO error */
+        goto fail_convert;
+    }
+
+    text[charCnt] = L'\0';
+
+    freeMem(bytes);
+    CloseHandle(file);
+
+    return text;
+
+fail_convert:
+    freeStr(text);
+fail_text:
+fail_decode:
+fail_read:
+    freeMem(bytes);
+fail_bytes:
+fail_size:
+    CloseHandle(file);
+fail_file:
+    return NULL;
+}
+
+int addPrefix(const wchar_t *line, const wchar_t *end, wchar_t **dest)
+{
+    Prefix *slot;
+    const wchar_t *sep;
+    wchar_t *str;
+    size_t hash;
+    size_t bit;
+    size_t ii;
+
+    str = *dest;
+    hash = FNV_OFFSET_BASIS;
+
+    /* Lines like "\" have no components and are ignored. */
+
+    for (; line < end; line = sep + 1)
+    {
+        sep = findSeparator(line, end);
+
+        if (sep == line)
+            continue;
+
+        if (*dest != str)
+        {
+            *(*dest)++ = L'/';
+            hash = FNV_STEP(hash, L'/');
+        }
+
+        foldPathRange(*dest, line, sep - line);
+        hash = hashFoldedRange(hash, line, sep - line);
+        *dest += sep - line;
+    }
+
+    if (*dest == str)
+        return 0;
+
+    for (ii = hash & slotMask; slots[ii].str; ii = (ii + 1) & slotMask)
+    {
+        slot = &slots[ii];
+
+        if (slot->hash == hash
+            && slot->len == (size_t) (*dest - str)
+            && !wmemcmp(slot->str, str, slot->len))
+        {
+            /* A duplicate, its characters are reused. */
+
+            *dest = str;
+            return 0;
+        }
+    }
+
+    if (prefixCnt == slotMask)
+    {
+        /* TODO error */
+        return 1;
+    }
+
+    slot = &slots[ii];
+    slot->str = str;
+    slot->len = *dest - str;
+    slot->hash = hash;
+    prefixCnt++;
+
+    for (ii = 0; ii < PROBE_CNT; ii++)
+    {
+        hash = mixHash(hash);
+        bit = hash & bitMask;
+        bits[bit / CHAR_BIT] |= 1 << bit % CHAR_BIT;
+    }
+
+    return 0;
+}
+
+size_t mixHash(size_t hash)
+{
+    /* The finalizer of MurmurHash3, every probe of the Bloom filter mixes the
+    ** previous one again.
+    */
+
+    hash ^= hash >> 16;
+    hash *= 0x85EBCA6BU;
+    hash ^= hash >> 13;
+    hash *= 0xC2B2AE35U;
+    hash ^= hash >> 16;
+
+    return hash;
+}
+
+bool mayContain(size_t hash)
+{
+    size_t bit;
+    size_t ii;
+
+    for (ii = 0; ii < PROBE_CNT; ii++)
+    {
+        hash = mixHash(hash);
+        bit = hash & bitMask;
+
+        if (!(bits[bit / CHAR_BIT] & 1 << bit % CHAR_BIT))
+            return false;
+    }
+
+    return true;
+}
+
+bool contains(const wchar_t *path, const wchar_t *end, size_t hash)
+{
+    size_t ii;
+
+    for (ii = hash & slotMask; slots[ii].str; ii = (ii + 1) & slotMask)
+    {
+        if (slots[ii].hash == hash && isSamePrefix(&slots[ii], path, end))
+            return true;
+    }
+
+    return false;
+}
+
+bool isSamePrefix(const Prefix *prefix,
+                  const wchar_t *path,
+                  const wchar_t *end)
+{
+    const wchar_t *str;
+    const wchar_t *strEnd;
+    const wchar_t *sep;
+
+    /* The prefix of the path is folded and its separators are collapsed on
+    ** the fly, the same way the prefixes of the list were stored.
+    */
+
+    str = prefix->str;
+    strEnd = str + prefix->len;
+
+    for (; path < end; path = sep + 1)
+    {
+        sep = findSeparator(path, end);
+
+        if (sep == path)
+            continue;
+
+        if (str != prefix->str && (str == strEnd || *str++ != L'/'))
+            return false;
+
+        if ((size_t) (strEnd - str) < (size_t) (sep - path)
+            || !isFoldedRange(str, path, sep - path))
+        {
+            return false;
+        }
+
+        str += sep - path;
+    }
+
+    return str == strEnd;
+}
@@ -0,0 +1,68 @@
+/*
+This file is part of NppEventExec
+Copyright (C) 2016-2017 Mihail Ivanchev
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef __EXCLUSION_H__
+#define __EXCLUSION_H__
+
+/**
+ * The size of the exclusion list and how well its Bloom filter performed. A
+ * false positive is a prefix of a path which passed the Bloom filter but
+ * isn't in the list.
+ */
+typedef struct
+{
+    size_t prefixCnt;
+    size_t memSize;
+    double expectedFpRate;
+    unsigned long long checkCnt;
+    unsigned long long excludedCnt;
+    unsigned long long lookupCnt;
+    unsigned long long falsePositiveCnt;
+} ExclusionStats;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Replaces the exclusion list with the one in a file. The file is encoded in
+ * UTF-8 and holds a path prefix per line, e.g. D:\repos\app\node_modules.
+ * Empty lines and lines starting with '#' are ignored. A missing file yields
+ * an empty list.
+ * \param path the path of the file.
+ * \return 0 upon success, non-zero otherwise in which case the list is empty.
+ */
+int loadExclusions(const wchar_t *path);
+
+void clearExclusions(void);
+
+/**
+ * Checks whether a path is excluded, i.e. whether any of its directories or
+ * the path itself is in the exclusion list. The comparison is
+ * case-insensitive, slashes and backslashes are equivalent.
+ * \param path the path to check.
+ * \return non-zero if the path is excluded, 0 otherwise.
+ */
+int isPathExcluded(const wchar_t *path);
+
+void getExclusionStats(ExclusionStats *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __EXCLUSION_H__ */
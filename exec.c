@@ -23,100 +23,211 @@ along with this program. If not, see <http://www.gnu.org/licenses/>.
 #include "Notepad_plus_msgs.h"
 #include "nppexec_msgs.h"
 #include "mem.h"
+#include "pool.h"
 #include "plugin.h"
 #include "queue_dlg.h"
 #include "resource.h"
 #include "util.h"
 
-/** TODO */
-#define UPDATE_INTERVAL_IN_MS 100
+/**
+ * The interval at which NppExec is polled right after a script started. It's
+ * USER_TIMER_MINIMUM, timers don't fire any faster.
+ */
+#define MIN_POLL_INTERVAL_IN_MS 10
+
+/** The interval the polling of a long-running script backs off to. */
+#define MAX_POLL_INTERVAL_IN_MS 200
+
+/** The initial capacity of the queue, a power of 2. */
+#define MIN_CAPACITY 16
+
+/** The number of hash buckets of the queued executions, a power of 2. */
+#define BUCKET_CNT 64
+
+/**
+ * How long an execution waits in the queue until it's on par with a fresh
+ * execution of the next higher priority class.
+ */
+#define AGING_INTERVAL_IN_MS 2000
+
+/** The number of executions allocated at once. */
+#define EXECS_PER_SLAB 32
+
+/**
+ * The length in code units, including the null character, of the paths of
+ * the smallest size class. Every following class doubles the length.
+ */
+#define MIN_PATH_CLASS_LEN 64
+
+/** The number of size classes of the paths. */
+#define PATH_CLASS_CNT 4
+
+/** The number of paths of a size class allocated at once. */
+#define PATHS_PER_SLAB 8
+
+#define PATH_POOL(cls)                                                       \
+    POOL_INITIALIZER(sizeof(SharedPath)                                      \
+                     + (MIN_PATH_CLASS_LEN << (cls)) * sizeof(wchar_t),      \
+                     PATHS_PER_SLAB)
+
+/* The path of a buffer, shared by all executions for it. The paths are
+** chained into hash buckets by buffer; a buffer has more than one if it was
+** renamed while executions for the old path were still queued.
+*/
+
+typedef struct _SharedPath
+{
+    unsigned int refCnt;
+    unsigned int sizeClass;
+    uptr_t bufId;
+    struct _SharedPath *next;
+    wchar_t str[];
+} SharedPath;
 
 typedef struct _Exec
 {
     const Rule *rule;
     ExecState state;
+    LARGE_INTEGER queuedAt;
+    long long rank;
+    unsigned int mergeCnt;
+    bool indexed;
     struct _Exec *next;
-    wchar_t *path;
-    wchar_t args[];
+    SharedPath *path;
 } Exec;
 
-static Exec* allocExec(size_t pathLen, uptr_t bufIdDigitCnt, size_t *argsLen);
-static bool initArgs(Exec *exec,
-                     size_t argsLen,
-                     size_t pathLen,
-                     const wchar_t *path,
-                     uptr_t bufIdDigitCnt,
-                     uptr_t bufId);
+static int mergeExec(Exec *exec, uptr_t bufId, const wchar_t *path);
+static void freeExec(Exec *exec);
+static bool buildArgs(const Exec *exec);
+static SharedPath* acquirePath(uptr_t bufId, const wchar_t *path);
+static void releasePath(SharedPath *shared);
 static uptr_t countBufIdDigits(uptr_t bufId);
 static void CALLBACK timerProc(HWND wnd,
                                UINT msg,
                                UINT_PTR timerId,
                                DWORD sysTime);
-static Exec* getExecAt(int pos);
+static void pollQueue(bool completed);
+static void schedulePoll(bool reset);
+static void recordStart(const Exec *exec);
+static long long rankExec(const Exec *exec);
+static unsigned int insertExec(Exec *exec);
+static bool growQueue(void);
+static void releaseQueue(void);
+static Exec** getSlotAt(unsigned int pos);
+static Exec* getExecAt(unsigned int pos);
+static unsigned int hashExec(const Rule *rule, uptr_t bufId);
+static unsigned int hashBufId(uptr_t bufId);
+static Exec** findQueued(const Rule *rule, uptr_t bufId);
+static void indexExec(Exec *exec);
+static void unindexExec(Exec *exec);
+
+/* The queue is a ring buffer of queue.capacity slots, a power of 2, starting
+** at queue.head. It grows by doubling and shrinks back once it runs empty, so
+** the executions can be reached by their position in constant time.
+**
+** The executions are ordered by their rank, see rankExec(), except for the
+** one at the head, which might already be passed to NppExec and is never
+** displaced.
+**
+** The executions of rules which coalesce are additionally chained into hash
+** buckets by rule and buffer while they're still queued, so a duplicate can
+** be found without walking the queue.
+**
+** The executions and their paths come from pools, which keep their memory
+** until freeQueueMemory() is called. The arguments are only formatted for
+** the execution passed to NppExec, into a buffer which is reused as well.
+*/
 
 static struct
 {
-    Exec *first;
-    Exec *last;
+    Exec **execs;
+    unsigned int capacity;
+    unsigned int head;
     unsigned int size;
     unsigned int foregroundCnt;
     UINT_PTR timerId;
+    UINT pollInterval;
+    unsigned int lastAddPos;
+    wchar_t *args;
+    size_t argsCap;
+    Exec *buckets[BUCKET_CNT];
+    SharedPath *paths[BUCKET_CNT];
 } queue;
 
+static Pool execPool = POOL_INITIALIZER(sizeof(Exec), EXECS_PER_SLAB);
+static Pool pathPools[PATH_CLASS_CNT] = {
+    PATH_POOL(0), PATH_POOL(1), PATH_POOL(2), PATH_POOL(3)
+};
+static ExecStats stats;
+
 int execRule(uptr_t bufId, const wchar_t *path, const Rule *rule)
 {
     Exec *exec;
-    Exec *prevExec;
-    uptr_t bufIdDigitCnt;
-    size_t pathLen;
-    size_t argsLen;
+    Exec **link;
+    unsigned int ii;
 
     assert(path);
     assert(rule);
 
+    if (rule->coalesce != COALESCE_NEVER
+        && *(link = findQueued(rule, bufId)))
+    {
+        return mergeExec(*link, bufId, path);
+    }
+
     if (queue.size == INT_MAX)
     {
         /* TODO error */
         goto fail_too_many_execs;
     }
+    if (queue.size == queue.capacity && !growQueue())
+    {
+        /* TODO error */
+        goto fail_too_many_execs;
+    }
 
     queue.size++;
     queue.foregroundCnt += !rule->background;
 
-    pathLen = wcslen(path);
-    bufIdDigitCnt = countBufIdDigits(bufId);
-
-    if (!(exec = allocExec(pathLen, bufIdDigitCnt, &argsLen)))
+    if (!(exec = allocFromPool(&execPool)))
     {
         /* TODO error */
         goto fail_alloc;
     }
 
-    if (!initArgs(exec, argsLen, pathLen, path, bufIdDigitCnt, bufId))
+    exec->indexed = false;
+
+    if (!(exec->path = acquirePath(bufId, path)))
     {
         /* TODO error */
-        goto fail_args;
+        goto fail_path;
     }
 
     exec->rule = rule;
     exec->state = STATE_QUEUED;
-    exec->next = NULL;
+    exec->mergeCnt = 0;
+    QueryPerformanceCounter(&exec->queuedAt);
+    exec->rank = rankExec(exec);
 
-    if (!queue.first)
+    if (queue.size == 1)
     {
         if (!(queue.timerId
-                  = SetTimer(NULL, 0, UPDATE_INTERVAL_IN_MS, timerProc)))
+                  = SetTimer(NULL, 0, MIN_POLL_INTERVAL_IN_MS, timerProc)))
         {
             /* TODO error */
             goto fail_timer;
         }
 
-        /* Get rid of a 'maybe uninitialized' warning. */
-        prevExec = NULL;
+        queue.pollInterval = MIN_POLL_INTERVAL_IN_MS;
+    }
+
+    queue.lastAddPos = insertExec(exec);
 
-        queue.first = exec;
-        queue.last = exec;
+    if (rule->coalesce != COALESCE_NEVER)
+        indexExec(exec);
 
+    if (queue.size == 1)
+    {
         /* If we're adding a background rule, try to pass it to Notepad++ for
         ** execution immediately. However do NOT schedule a background rule at
         ** this point, because the blocking dialog must be opened and this
@@ -127,12 +238,6 @@ int execRule(uptr_t bufId, const wchar_t *path, const Rule *rule)
         if (rule->background)
             updateQueue();
     }
-    else
-    {
-        prevExec = queue.last;
-        queue.last->next = exec;
-        queue.last = exec;
-    }
 
     if (isQueueDlgVisible())
     {
@@ -148,53 +253,65 @@ int execRule(uptr_t bufId, const wchar_t *path, const Rule *rule)
 
     return 0;
 
+    /* The execution is taken out of the queue again. */
+
 fail_dlg:
 
-    if (!prevExec)
-    {
+    for (ii = queue.lastAddPos; ii < queue.size - 1; ii++)
+        *getSlotAt(ii) = getExecAt(ii + 1);
+
+    if (queue.size == 1)
         stopQueue();
-        queue.first = NULL;
-        queue.last = NULL;
-    }
-    else
-    {
-        queue.last = prevExec;
-        queue.last->next = NULL;
-    }
 
 fail_timer:
-fail_args:
-    freeMem(exec);
+fail_path:
+    freeExec(exec);
 fail_alloc:
     queue.foregroundCnt -= !rule->background;
     queue.size--;
+
+    if (!queue.size)
+        releaseQueue();
+
 fail_too_many_execs:
     return 1;
 }
 
 void emptyQueue(void)
 {
-    Exec *exec;
-    Exec *next;
+    unsigned int ii;
 
     assert(queue.size);
     assert(!queue.foregroundCnt);
 
-    exec = queue.first;
-
-    do
-    {
-        next = exec->next;
-        freeMem(exec);
-        exec = next;
-    }
-    while (exec);
+    for (ii = 0; ii < queue.size; ii++)
+        freeExec(getExecAt(ii));
 
     stopQueue();
 
-    queue.first = NULL;
-    queue.last = NULL;
     queue.size = 0;
+    releaseQueue();
+}
+
+void freeQueueMemory(void)
+{
+    unsigned int ii;
+
+    assert(!queue.size);
+
+    freeMem(queue.execs);
+    freeMem(queue.args);
+
+    queue.execs = NULL;
+    queue.capacity = 0;
+    queue.head = 0;
+    queue.args = NULL;
+    queue.argsCap = 0;
+
+    clearPool(&execPool);
+
+    for (ii = 0; ii < PATH_CLASS_CNT; ii++)
+        clearPool(&pathPools[ii]);
 }
 
 int isQueueEmpty(void)
@@ -204,41 +321,88 @@ int isQueueEmpty(void)
 
 void updateQueue(void)
 {
-    Exec *next;
+    Exec *first;
     NpeNppExecParam npep;
     DWORD state;
 
     assert(queue.size);
 
-    if (queue.first->state == STATE_EXECUTING)
+    first = getExecAt(0);
+
+    if (first->state == STATE_EXECUTING)
     {
         sendNppExecMsg(NPEM_GETSTATE, &state);
         if (state != NPE_STATEREADY)
             return;
 
         queue.size--;
-        queue.foregroundCnt -= !queue.first->rule->background;
+        queue.foregroundCnt -= !first->rule->background;
+        queue.head = (queue.head + 1) & (queue.capacity - 1);
 
-        next = queue.first->next;
-        freeMem(queue.first);
-        queue.first = next;
+        freeExec(first);
 
-        if (!next)
+        if (!queue.size)
         {
             stopQueue();
-            queue.last = NULL;
+            releaseQueue();
             return;
         }
 
         /* The state is updated below. */
+
+        first = getExecAt(0);
+    }
+
+    /* Once passed to NppExec the arguments are fixed, so later duplicates
+    ** are queued on their own.
+    */
+
+    if (first->indexed)
+        unindexExec(first);
+
+    if (!buildArgs(first))
+    {
+        /* TODO error */
+        return;
     }
 
-    npep.szScriptName = queue.first->rule->cmd;
-    npep.szScriptArguments = queue.first->args;
-    npep.dwResult = 0;
-    sendNppExecMsg(NPEM_NPPEXEC, &npep);
-    queue.first->state = npep.dwResult ==
-                         NPE_EXECUTE_OK ? STATE_EXECUTING : STATE_WAITING;
+    /* A non-zero result asks NppExec to send NPEN_RESULT once the script
+    ** has finished, see onExecResult(). It's also the value of
+    ** NPE_EXECUTE_OK, so it's only trusted if NppExec got the message.
+    */
+
+    npep.szScriptName = first->rule->cmd;
+    npep.szScriptArguments = queue.args;
+    npep.dwResult = 1;
+    first->state = sendNppExecMsg(NPEM_NPPEXEC, &npep)
+                   && npep.dwResult == NPE_EXECUTE_OK ? STATE_EXECUTING
+                                                      : STATE_WAITING;
+
+    /* Quick scripts are caught by polling tightly right after the start. */
+
+    if (first->state == STATE_EXECUTING)
+    {
+        recordStart(first);
+        schedulePoll(true);
+    }
+}
+
+void onExecResult(void)
+{
+    /* The notification might be for a script which was already found to be
+    ** finished by polling. It's only acted on if a script is running.
+    */
+
+    if (!queue.size || getExecAt(0)->state != STATE_EXECUTING)
+        return;
+
+    stats.resultCnt++;
+    pollQueue(true);
+}
+
+void getExecStats(ExecStats *res)
+{
+    *res = stats;
 }
 
 void stopQueue(void)
@@ -254,42 +418,46 @@ unsigned int getQueueSize(unsigned int *foregroundCnt)
 
 void abortExecs(int *positions)
 {
-    Exec *prevExec;
-    Exec *currExec;
-    Exec *nextExec;
-    int adjustedPos;
+    Exec *exec;
+    unsigned int src;
+    unsigned int dest;
     int ii;
 
     assert(positions);
 
-    prevExec = NULL;
-    currExec = queue.first;
-    adjustedPos = 0;
+    if (positions[0] == -1)
+        return;
 
-    for (ii = 0; positions[ii] != -1; ii++)
-    {
-        for (; adjustedPos < positions[ii] - ii; adjustedPos++)
-        {
-            prevExec = currExec;
-            currExec = currExec->next;
-        }
+    /* The positions are ascending, so the executions after the first one
+    ** are compacted in a single pass.
+    */
 
-        queue.foregroundCnt -= !currExec->rule->background;
+    dest = (unsigned int) positions[0];
+    ii = 0;
 
-        nextExec = currExec->next;
-        freeMem(currExec);
-        currExec = nextExec;
+    for (src = dest; src < queue.size; src++)
+    {
+        exec = getExecAt(src);
 
-        if (prevExec)
-            prevExec->next = currExec;
+        if (positions[ii] != -1 && src == (unsigned int) positions[ii])
+        {
+            queue.foregroundCnt -= !exec->rule->background;
+            freeExec(exec);
+            ii++;
+        }
         else
-            queue.first = currExec;
+        {
+            *getSlotAt(dest++) = exec;
+        }
     }
 
-    if (!currExec && !(queue.last = prevExec))
-        stopQueue();
-
     queue.size -= ii;
+
+    if (!queue.size)
+    {
+        stopQueue();
+        releaseQueue();
+    }
 }
 
 const wchar_t* getExecRule(unsigned int pos)
@@ -313,7 +481,12 @@ const wchar_t* getExecPath(unsigned int pos)
 
     assert(pos < queue.size);
 
-    return getExecAt(pos)->path;
+    return getExecAt(pos)->path->str;
+}
+
+unsigned int getLastAddedExecPos(void)
+{
+    return queue.lastAddPos;
 }
 
 int isExecForeground(unsigned int pos)
@@ -324,17 +497,79 @@ int isExecForeground(unsigned int pos)
     return !getExecAt(pos)->rule->background;
 }
 
-bool initArgs(Exec *exec,
-              size_t argsLen,
-              size_t pathLen,
-              const wchar_t *path,
-              uptr_t bufIdDigitCnt,
-              uptr_t bufId)
+unsigned int getExecMergeCount(unsigned int pos)
 {
-    assert(argsLen);
-    assert(pathLen);
-    assert(path);
-    assert(bufIdDigitCnt);
+
+    assert(pos < queue.size);
+
+    return getExecAt(pos)->mergeCnt;
+}
+
+int mergeExec(Exec *exec, uptr_t bufId, const wchar_t *path)
+{
+    SharedPath *shared;
+
+    assert(exec->state == STATE_QUEUED);
+
+    /* The execution keeps its place in the queue, only the path it's run
+    ** for is replaced in case the buffer was renamed meanwhile.
+    */
+
+    if (exec->rule->coalesce == COALESCE_KEEP_LATEST)
+    {
+        if (!(shared = acquirePath(bufId, path)))
+        {
+            /* TODO error */
+            return 1;
+        }
+
+        releasePath(exec->path);
+        exec->path = shared;
+    }
+
+    exec->mergeCnt++;
+    stats.mergeCnt++;
+
+    if (isQueueDlgVisible())
+        processQueueEvent(QUEUE_MERGE);
+
+    return 0;
+}
+
+void freeExec(Exec *exec)
+{
+    if (exec->indexed)
+        unindexExec(exec);
+    if (exec->path)
+        releasePath(exec->path);
+
+    freeToPool(&execPool, exec);
+}
+
+bool buildArgs(const Exec *exec)
+{
+    wchar_t *args;
+    uptr_t bufId;
+    uptr_t bufIdDigitCnt;
+    size_t pathLen;
+    size_t len;
+
+    bufId = exec->path->bufId;
+    bufIdDigitCnt = countBufIdDigits(bufId);
+    pathLen = wcslen(exec->path->str);
+
+    /* Check if we can fit all the string data we need to store. The magic
+    ** number 6 is the extra space required to store 4 double quotes ("),
+    ** 1 space and the null character (\0).
+    */
+
+    if (pathLen > SIZE_MAX - 6 || bufIdDigitCnt > SIZE_MAX - 6 - pathLen)
+    {
+        /* TODO error */
+        return false;
+    }
+
+    len = 6 + pathLen + bufIdDigitCnt;
 
     if (bufIdDigitCnt > INT_MAX)
     {
@@ -342,14 +577,32 @@ bool initArgs(Exec *exec,
         return false;
     }
 
-    StringCchPrintfW(exec->args,
-                     argsLen,
-                     L"\"%*s\" \"%s\"%c%s",
+    /* The buffer only grows, it's needed for every execution. */
+
+    if (len > queue.argsCap)
+    {
+        if (len > SIZE_MAX / sizeof *args)
+        {
+            /* TODO error */
+            return false;
+        }
+        if (!(args = allocMem(len * sizeof *args)))
+        {
+            /* TODO error */
+            return false;
+        }
+
+        freeMem(queue.args);
+        queue.args = args;
+        queue.argsCap = len;
+    }
+
+    StringCchPrintfW(queue.args,
+                     len,
+                     L"\"%*s\" \"%s\"",
                      (int) bufIdDigitCnt,
                      L"",
-                     path,
-                     L'\0',
-                     path);
+                     exec->path->str);
 
     /* Copy the buffer ID the hard way, because its type is not supported by
     ** *PrintfW or we don't know which specifier to use.
@@ -357,55 +610,84 @@ bool initArgs(Exec *exec,
 
     do
     {
-        exec->args[bufIdDigitCnt--] = L'0' + (bufId % 10);
+        queue.args[bufIdDigitCnt--] = L'0' + (bufId % 10);
     }
     while (bufId /= 10, bufIdDigitCnt);
 
-    exec->path = exec->args + wcslen(exec->args);
-
     return true;
 }
 
-Exec* allocExec(size_t pathLen, uptr_t bufIdDigitCnt, size_t *argsLen)
+SharedPath* acquirePath(uptr_t bufId, const wchar_t *path)
 {
-    Exec *exec;
+    SharedPath **bucket;
+    SharedPath *shared;
     size_t len;
+    unsigned int cls;
 
-    assert(pathLen);
-    assert(bufIdDigitCnt);
-    assert(argsLen);
+    bucket = &queue.paths[hashBufId(bufId)];
 
-    /* Check if we can fit all the string data we need to store. The magic
-        ** number 7 is the extra space required to store 4 double quotes ("),
-        ** 1 space and 2 null characters (\0).
-        */
+    /* All the executions for a notification share the path, so do the later
+    ** ones for the same buffer unless it was renamed meanwhile.
+    */
 
-    if (pathLen > (SIZE_MAX - 7) / 2
-        || bufIdDigitCnt > SIZE_MAX - 7 - 2 * pathLen)
+    for (shared = *bucket; shared; shared = shared->next)
     {
-        /* TODO error */
-        return NULL;
+        if (shared->bufId == bufId && !wcscmp(shared->str, path))
+        {
+            shared->refCnt++;
+            return shared;
+        }
     }
 
-    len = 7 + 2 * pathLen + bufIdDigitCnt;
+    len = wcslen(path) + 1;
+    cls = 0;
 
-    if (len > (SIZE_MAX - sizeof *exec) / sizeof exec->args[0])
-    {
-        /* TODO error */
-        return NULL;
-    }
+    while (cls < PATH_CLASS_CNT && len > (size_t) MIN_PATH_CLASS_LEN << cls)
+        cls++;
+
+    /* Paths longer than the largest size class come from the heap. */
 
-    /* Allocate memory for the struct and the trailing string buffer. */
+    if (cls < PATH_CLASS_CNT)
+        shared = allocFromPool(&pathPools[cls]);
+    else if (len <= (SIZE_MAX - sizeof *shared) / sizeof *shared->str)
+        shared = allocMem(sizeof *shared + len * sizeof *shared->str);
+    else
+        shared = NULL;
 
-    if (!(exec = allocMem(sizeof *exec + len * sizeof exec->args[0])))
+    if (!shared)
     {
         /* TODO error */
         return NULL;
     }
 
-    *argsLen = len;
+    memcpy(shared->str, path, len * sizeof *path);
+    shared->refCnt = 1;
+    shared->sizeClass = cls;
+    shared->bufId = bufId;
+    shared->next = *bucket;
+    *bucket = shared;
+
+    return shared;
+}
+
+void releasePath(SharedPath *shared)
+{
+    SharedPath **link;
+
+    if (--shared->refCnt)
+        return;
+
+    link = &queue.paths[hashBufId(shared->bufId)];
 
-    return exec;
+    while (*link != shared)
+        link = &(*link)->next;
+
+    *link = shared->next;
+
+    if (shared->sizeClass < PATH_CLASS_CNT)
+        freeToPool(&pathPools[shared->sizeClass], shared);
+    else
+        freeMem(shared);
 }
 
 uptr_t countBufIdDigits(uptr_t bufId)
@@ -424,14 +706,20 @@ uptr_t countBufIdDigits(uptr_t bufId)
 }
 
 void CALLBACK timerProc(HWND wnd, UINT msg, UINT_PTR timerId, DWORD sysTime)
+{
+    stats.pollCnt++;
+    pollQueue(false);
+}
+
+void pollQueue(bool completed)
 {
     unsigned int prevCnt;
     ExecState prevState;
     bool background;
 
     prevCnt = queue.size;
-    prevState = queue.first->state;
-    background = queue.first->rule->background;
+    prevState = getExecAt(0)->state;
+    background = getExecAt(0)->rule->background;
 
     updateQueue();
 
@@ -443,21 +731,231 @@ void CALLBACK timerProc(HWND wnd, UINT msg, UINT_PTR timerId, DWORD sysTime)
                               : QUEUE_REMOVE_FOREGROUND);
         }
     }
-    else if (prevState != queue.first->state)
+    else if (prevState != getExecAt(0)->state)
     {
         if (isQueueDlgVisible())
             processQueueEvent(QUEUE_STATUS_UPDATE);
     }
+    else
+    {
+        /* Nothing changed, so the script is still running or NppExec is still
+        ** busy otherwise. The polling backs off unless NppExec reported that
+        ** the script has finished, then its state should change any moment.
+        */
+
+        schedulePoll(completed);
+    }
 }
 
-Exec* getExecAt(int pos)
+void schedulePoll(bool reset)
 {
-    Exec *exec;
+    UINT_PTR timerId;
+    UINT interval;
+
+    if (reset)
+        interval = MIN_POLL_INTERVAL_IN_MS;
+    else if (queue.pollInterval < MAX_POLL_INTERVAL_IN_MS / 2)
+        interval = 2 * queue.pollInterval;
+    else
+        interval = MAX_POLL_INTERVAL_IN_MS;
+
+    if (interval == queue.pollInterval)
+        return;
+
+    /* Setting the timer again under its ID changes the interval. Windows
+    ** might return a new ID for a thread timer, so it's kept.
+    */
+
+    if (!(timerId = SetTimer(NULL, queue.timerId, interval, timerProc)))
+    {
+        /* TODO error */
+        return;
+    }
+
+    queue.timerId = timerId;
+
+    queue.pollInterval = interval;
+}
+
+void recordStart(const Exec *exec)
+{
+    LARGE_INTEGER freq;
+    LARGE_INTEGER now;
+    unsigned long long ticks;
+    unsigned long long nanos;
+
+    QueryPerformanceFrequency(&freq);
+    QueryPerformanceCounter(&now);
+
+    /* Split up to not overflow for long waits. */
+
+    ticks = now.QuadPart - exec->queuedAt.QuadPart;
+    nanos = ticks / freq.QuadPart * 1000000000ULL
+            + ticks % freq.QuadPart * 1000000000ULL / freq.QuadPart;
+
+    stats.startCnt++;
+    stats.totalWaitNanos += nanos;
+
+    if (nanos > stats.maxWaitNanos)
+        stats.maxWaitNanos = nanos;
+}
+
+long long rankExec(const Exec *exec)
+{
+    LARGE_INTEGER freq;
+    int cls;
+
+    /* The effective priority of an execution is its class plus one for
+    ** every AGING_INTERVAL_IN_MS it waited. The difference of two effective
+    ** priorities doesn't change as time goes on, so the executions are
+    ** ordered once by the time they would have been queued with the lowest
+    ** class. That way every execution gets its turn eventually.
+    */
+
+    QueryPerformanceFrequency(&freq);
+
+    cls = getEffectivePriority(exec->rule) - PRIORITY_LOW;
+
+    return exec->queuedAt.QuadPart
+           - cls * (AGING_INTERVAL_IN_MS * freq.QuadPart / 1000);
+}
+
+unsigned int insertExec(Exec *exec)
+{
+    unsigned int pos;
+
+    /* Executions of the same rank keep the order they were queued in. */
+
+    pos = queue.size - 1;
+
+    while (pos > 1 && getExecAt(pos - 1)->rank > exec->rank)
+    {
+        *getSlotAt(pos) = getExecAt(pos - 1);
+        pos--;
+    }
+
+    *getSlotAt(pos) = exec;
+
+    return pos;
+}
+
+bool growQueue(void)
+{
+    Exec **execs;
+    unsigned int capacity;
+    unsigned int ii;
+
+    capacity = queue.capacity ? 2 * queue.capacity : MIN_CAPACITY;
+
+    if (capacity > SIZE_MAX / sizeof *execs)
+    {
+        /* TODO error */
+        return false;
+    }
+    if (!(execs = allocMem(capacity * sizeof *execs)))
+    {
+        /* TODO error */
+        return false;
+    }
+
+    /* The executions are moved to the start of the new buffer. */
+
+    for (ii = 0; ii < queue.size; ii++)
+        execs[ii] = getExecAt(ii);
+
+    freeMem(queue.execs);
+
+    queue.execs = execs;
+    queue.capacity = capacity;
+    queue.head = 0;
+
+    return true;
+}
+
+void releaseQueue(void)
+{
+    assert(!queue.size);
+
+    /* The smallest buffer is kept, since a queue which runs empty after every
+    ** execution would allocate it again right away.
+    */
+
+    if (queue.capacity > MIN_CAPACITY)
+    {
+        freeMem(queue.execs);
+
+        queue.execs = NULL;
+        queue.capacity = 0;
+    }
+
+    queue.head = 0;
+}
+
+Exec** getSlotAt(unsigned int pos)
+{
+    return &queue.execs[(queue.head + pos) & (queue.capacity - 1)];
+}
+
+Exec* getExecAt(unsigned int pos)
+{
+    return *getSlotAt(pos);
+}
+
+unsigned int hashBufId(uptr_t bufId)
+{
+    /* Buffer IDs are addresses, so their low bits are always zero. */
+
+    return (unsigned int) (bufId >> 4 ^ bufId >> 10) & (BUCKET_CNT - 1);
+}
+
+unsigned int hashExec(const Rule *rule, uptr_t bufId)
+{
+    uptr_t hash;
+
+    /* The low bits of the rule address are always zero due to alignment. */
+
+    hash = ((uptr_t) rule >> 4) ^ bufId;
+    hash ^= hash >> 7 ^ hash >> 13;
+
+    return (unsigned int) hash & (BUCKET_CNT - 1);
+}
+
+Exec** findQueued(const Rule *rule, uptr_t bufId)
+{
+    Exec **link;
+
+    link = &queue.buckets[hashExec(rule, bufId)];
+
+    while (*link && ((*link)->rule != rule || (*link)->path->bufId != bufId))
+        link = &(*link)->next;
+
+    return link;
+}
+
+void indexExec(Exec *exec)
+{
+    Exec **bucket;
+
+    assert(!exec->indexed);
+
+    bucket = &queue.buckets[hashExec(exec->rule, exec->path->bufId)];
+
+    exec->next = *bucket;
+    exec->indexed = true;
+    *bucket = exec;
+}
+
+void unindexExec(Exec *exec)
+{
+    Exec **link;
+
+    assert(exec->indexed);
 
-    exec = queue.first;
+    link = &queue.buckets[hashExec(exec->rule, exec->path->bufId)];
 
-    for (; pos; pos--)
-        exec = exec->next;
+    while (*link != exec)
+        link = &(*link)->next;
 
-    return exec;
+    *link = exec->next;
+    exec->indexed = false;
 }
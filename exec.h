@@ -18,14 +18,45 @@ along with this program. If not, see <http://www.gnu.org/licenses/>.
 #ifndef __EXEC__H__
 #define __EXEC__H__
 
+/**
+ * How long the executions waited in the queue until NppExec started them,
+ * in nanoseconds, and how their completion was detected: by polling the state
+ * of NppExec or by its NPEN_RESULT notification. Executions which were merged
+ * into an already queued one of the same rule and buffer are counted apart.
+ */
+typedef struct
+{
+    unsigned long long startCnt;
+    unsigned long long totalWaitNanos;
+    unsigned long long maxWaitNanos;
+    unsigned long long pollCnt;
+    unsigned long long resultCnt;
+    unsigned long long mergeCnt;
+} ExecStats;
+
 #ifdef __cplusplus
 extern "C" {
 #endif
 
 int execRule(uptr_t bufferId, const wchar_t *path, const Rule *rule);
 void emptyQueue(void);
+
+/**
+ * Frees the memory the queue keeps for reuse. The queue has to be empty, it's
+ * called when the plugin is deinitialized.
+ */
+void freeQueueMemory(void);
+
 int isQueueEmpty(void);
 
+/**
+ * Handles the NPEN_RESULT notification of NppExec: the script it was asked to
+ * run has finished, so the next execution in the queue can start right away.
+ */
+void onExecResult(void);
+
+void getExecStats(ExecStats *stats);
+
 #ifdef __cplusplus
 }
 #endif
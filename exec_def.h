@@ -36,7 +36,8 @@ typedef enum
     QUEUE_ADD_FOREGROUND,
     QUEUE_REMOVE_BACKGROUND,
     QUEUE_REMOVE_FOREGROUND,
-    QUEUE_STATUS_UPDATE
+    QUEUE_STATUS_UPDATE,
+    QUEUE_MERGE
 } QueueEvent;
 
 void updateQueue(void);
@@ -47,6 +48,8 @@ const wchar_t* getExecRule(unsigned int pos);
 ExecState getExecState(unsigned int pos);
 const wchar_t* getExecPath(unsigned int pos);
 int isExecForeground(unsigned int pos);
+unsigned int getExecMergeCount(unsigned int pos);
+unsigned int getLastAddedExecPos(void);
 
 int isQueueDlgVisible(void);
 void processQueueEvent(QueueEvent event);
@@ -0,0 +1,344 @@
+/*
+This file is part of NppEventExec
+Copyright (C) 2016-2017 Mihail Ivanchev
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "base.h"
+#include "mem.h"
+#include "util.h"
+#include "hash.h"
+#include "path_scan.h"
+#include "glob.h"
+
+/** The suffix hash set has at least this many slots per pattern. */
+#define SLOTS_PER_PATTERN 2
+
+typedef struct
+{
+    const wchar_t *str;
+    size_t len;
+    size_t hash;
+} Suffix;
+
+typedef struct
+{
+    const wchar_t *pattern;
+    bool fullPath;
+} Wildcard;
+
+/**
+ * The patterns are folded and stored in GlobMatcher::buf, the suffixes and the
+ * wildcards point into it. GlobMatcher::suffixes is an open addressing hash
+ * set with GlobMatcher::suffixMask + 1 slots; GlobMatcher::suffixLens holds
+ * the distinct lengths of the suffixes, so a path is hashed once per length.
+ */
+struct _GlobMatcher
+{
+    wchar_t *buf;
+    Suffix *suffixes;
+    size_t suffixMask;
+    size_t *suffixLens;
+    size_t suffixLenCnt;
+    Wildcard *wildcards;
+    size_t wildcardCnt;
+};
+
+static void addSuffix(GlobMatcher *matcher, const wchar_t *str, size_t len);
+static bool hasSuffix(const GlobMatcher *matcher,
+                      const wchar_t *path,
+                      size_t pathLen);
+static bool isWildcardMatch(const wchar_t *pattern, const wchar_t *str);
+
+GlobMatcher* compileGlob(const wchar_t *globs)
+{
+    GlobMatcher *matcher;
+    wchar_t *item;
+    wchar_t *end;
+    wchar_t *next;
+    size_t itemCnt;
+    size_t slotCnt;
+    size_t ii;
+
+    assert(globs);
+
+    if (!(matcher = allocMem(sizeof *matcher)))
+    {
+        /* TODO error */
+        goto fail_matcher;
+    }
+    if (!(matcher->buf = copyStr(globs)))
+    {
+        /* TODO error */
+        goto fail_buf;
+    }
+
+    itemCnt = 1;
+
+    for (item = matcher->buf; *item; item++)
+    {
+        *item = foldPathChar(*item);
+        itemCnt += *item == L';';
+    }
+
+    if (itemCnt > SIZE_MAX / SLOTS_PER_PATTERN / sizeof(Suffix))
+    {
+        /* TODO error */
+        goto fail_too_many_items;
+    }
+
+    for (slotCnt = 1; slotCnt < SLOTS_PER_PATTERN * itemCnt; slotCnt <<= 1)
+        ;
+
+    if (!(matcher->suffixes = allocMem(slotCnt * sizeof(Suffix))))
+    {
+        /* TODO error */
+        goto fail_suffixes;
+    }
+    if (!(matcher->suffixLens = allocMem(itemCnt * sizeof(size_t))))
+    {
+        /* TODO error */
+        goto fail_suffix_lens;
+    }
+    if (!(matcher->wildcards = allocMem(itemCnt * sizeof(Wildcard))))
+    {
+        /* TODO error */
+        goto fail_wildcards;
+    }
+
+    for (ii = 0; ii < slotCnt; ii++)
+        matcher->suffixes[ii].str = NULL;
+
+    matcher->suffixMask = slotCnt - 1;
+    matcher->suffixLenCnt = 0;
+    matcher->wildcardCnt = 0;
+
+    for (item = matcher->buf; item; item = next)
+    {
+        if ((end = wcschr(item, L';')))
+        {
+            next = end + 1;
+        }
+        else
+        {
+            end = item + wcslen(item);
+            next = NULL;
+        }
+
+        while (item < end && IS_SPACE(*item))
+            item++;
+        while (end > item && IS_SPACE(end[-1]))
+            end--;
+
+        if (item == end)
+        {
+            /* TODO error */
+            goto fail_empty_item;
+        }
+
+        *end = L'\0';
+
+        /* A literal after a leading '*' is a plain suffix of the path no
+        ** matter whether it contains a separator.
+        */
+
+        if (item[0] == L'*' && item[1] && !wcspbrk(item + 1, L"*?"))
+        {
+            addSuffix(matcher, item + 1, end - item - 1);
+        }
+        else
+        {
+            matcher->wildcards[matcher->wildcardCnt].pattern = item;
+            matcher->wildcards[matcher->wildcardCnt].fullPath =
+                wcschr(item, L'/') != NULL;
+            matcher->wildcardCnt++;
+        }
+    }
+
+    return matcher;
+
+fail_empty_item:
+    freeMem(matcher->wildcards);
+fail_wildcards:
+    freeMem(matcher->suffixLens);
+fail_suffix_lens:
+    freeMem(matcher->suffixes);
+fail_suffixes:
+fail_too_many_items:
+    freeStr(matcher->buf);
+fail_buf:
+    freeMem(matcher);
+fail_matcher:
+    return NULL;
+}
+
+void freeGlob(GlobMatcher *matcher)
+{
+    if (!matcher)
+        return;
+
+    freeMem(matcher->wildcards);
+    freeMem(matcher->suffixLens);
+    freeMem(matcher->suffixes);
+    freeStr(matcher->buf);
+    freeMem(matcher);
+}
+
+int isGlobMatch(const GlobMatcher *matcher, const wchar_t *path)
+{
+    const wchar_t *filename;
+    const wchar_t *sep;
+    const Wildcard *wildcard;
+    size_t pathLen;
+    size_t ii;
+
+    assert(matcher);
+    assert(path);
+
+    pathLen = wcslen(path);
+
+    if (hasSuffix(matcher, path, pathLen))
+        return 1;
+
+    sep = findLastSeparator(path, path + pathLen);
+    filename = sep ? sep + 1 : path;
+
+    for (ii = 0; ii < matcher->wildcardCnt; ii++)
+    {
+        wildcard = &matcher->wildcards[ii];
+
+        if (isWildcardMatch(wildcard->pattern,
+                            wildcard->fullPath ? path : filename))
+        {
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+void addSuffix(GlobMatcher *matcher, const wchar_t *str, size_t len)
+{
+    Suffix *suffix;
+    size_t hash;
+    size_t ii;
+
+    hash = hashFoldedRange(FNV_OFFSET_BASIS, str, len);
+
+    for (ii = hash & matcher->suffixMask;
+         matcher->suffixes[ii].str;
+         ii = (ii + 1) & matcher->suffixMask)
+    {
+        suffix = &matcher->suffixes[ii];
+
+        if (suffix->hash == hash
+            && suffix->len == len
+            && !wmemcmp(suffix->str, str, len))
+        {
+            return;
+        }
+    }
+
+    suffix = &matcher->suffixes[ii];
+    suffix->str = str;
+    suffix->len = len;
+    suffix->hash = hash;
+
+    for (ii = 0; ii < matcher->suffixLenCnt; ii++)
+    {
+        if (matcher->suffixLens[ii] == len)
+            return;
+    }
+
+    matcher->suffixLens[matcher->suffixLenCnt++] = len;
+}
+
+bool hasSuffix(const GlobMatcher *matcher,
+               const wchar_t *path,
+               size_t pathLen)
+{
+    const Suffix *suffix;
+    const wchar_t *tail;
+    size_t hash;
+    size_t len;
+    size_t ii;
+    size_t jj;
+
+    for (ii = 0; ii < matcher->suffixLenCnt; ii++)
+    {
+        if ((len = matcher->suffixLens[ii]) > pathLen)
+            continue;
+
+        tail = path + pathLen - len;
+        hash = hashFoldedRange(FNV_OFFSET_BASIS, tail, len);
+
+        for (jj = hash & matcher->suffixMask;
+             matcher->suffixes[jj].str;
+             jj = (jj + 1) & matcher->suffixMask)
+        {
+            suffix = &matcher->suffixes[jj];
+
+            if (suffix->hash == hash
+                && suffix->len == len
+                && isFoldedRange(suffix->str, tail, len))
+            {
+                return true;
+            }
+        }
+    }
+
+    return false;
+}
+
+bool isWildcardMatch(const wchar_t *pattern, const wchar_t *str)
+{
+    const wchar_t *star;
+    const wchar_t *resume;
+
+    /* Only the last '*' is ever backtracked to: whatever an earlier one would
+    ** consume additionally can as well be consumed by the last one.
+    */
+
+    star = NULL;
+    resume = NULL;
+
+    while (*str)
+    {
+        if (*pattern == L'*')
+        {
+            star = ++pattern;
+            resume = str;
+        }
+        else if (*pattern
+                 && (*pattern == L'?' || *pattern == foldPathChar(*str)))
+        {
+            pattern++;
+            str++;
+        }
+        else if (star)
+        {
+            pattern = star;
+            str = ++resume;
+        }
+        else
+        {
+            return false;
+        }
+    }
+
+    while (*pattern == L'*')
+        pattern++;
+
+    return !*pattern;
+}
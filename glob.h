@@ -0,0 +1,57 @@
+/*
+This file is part of NppEventExec
+Copyright (C) 2016-2017 Mihail Ivanchev
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef __GLOB_H__
+#define __GLOB_H__
+
+/**
+ * A compiled list of glob patterns like "*.c;*.cpp;*.h". Patterns of the form
+ * *<literal> are looked up in a hash set of suffixes, all others are matched
+ * by a simple wildcard engine.
+ */
+typedef struct _GlobMatcher GlobMatcher;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Compiles a list of glob patterns separated by semicolons. A '*' matches any
+ * number of characters and a '?' matches a single character. Patterns are
+ * matched case-insensitively against the filename or, if they contain a path
+ * separator, against the whole path. Slashes and backslashes are equivalent.
+ * \param globs the glob patterns.
+ * \return the compiled matcher or NULL if the list contains an empty pattern
+ *         or the memory could not be allocated.
+ */
+GlobMatcher* compileGlob(const wchar_t *globs);
+
+void freeGlob(GlobMatcher *matcher);
+
+/**
+ * Checks whether a path matches any pattern of a compiled glob list.
+ * \param matcher the compiled glob list.
+ * \param path the path to check.
+ * \return non-zero if the path matches, 0 otherwise.
+ */
+int isGlobMatch(const GlobMatcher *matcher, const wchar_t *path);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __GLOB_H__ */
@@ -0,0 +1,33 @@
+/*
+This file is part of NppEventExec
+Copyright (C) 2016-2017 Mihail Ivanchev
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef __HASH_H__
+#define __HASH_H__
+
+/*
+The hash sets of the plugin use FNV-1a. A hash starts at FNV_OFFSET_BASIS
+and every value is mixed in with FNV_STEP; hashFoldedRange does this for the
+folded code units of a path.
+*/
+
+/** The initial value of an FNV-1a hash. */
+#define FNV_OFFSET_BASIS ((size_t) 2166136261U)
+
+/** Mixes a value into an FNV-1a hash. */
+#define FNV_STEP(hash, val) (((hash) ^ (size_t) (val)) * 16777619U)
+
+#endif /* __HASH_H__ */
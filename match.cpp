@@ -15,8 +15,121 @@ GNU General Public License for more details.
 You should have received a copy of the GNU General Public License
 along with this program. If not, see <http://www.gnu.org/licenses/>.
 */
+#include <cstddef>
 #include "match.h"
+#include "hash.h"
 #include <boost/regex.hpp>
+#include <algorithm>
+#include <chrono>
+#include <cwchar>
+#include <cwctype>
+#include <iterator>
+#include <map>
+#include <new>
+#include <string>
+#include <vector>
+
+/** The maximum number of characters boost may visit during a match. */
+#define MAX_MATCH_STEPS 1000000
+
+/** The maximum duration of a match with boost in milliseconds. */
+#define MAX_MATCH_MILLIS 100
+
+/** The clock is checked whenever this many steps were taken. */
+#define CLOCK_CHECK_INTERVAL 4096
+
+struct _Matcher
+{
+    const MatchBackend *backend;
+    void *regex;
+};
+
+/* The budget of a single match with boost. */
+
+typedef struct
+{
+    unsigned long steps;
+    std::chrono::steady_clock::time_point deadline;
+} MatchBudget;
+
+/* Thrown when a match runs out of its budget. */
+
+struct BudgetExceeded
+{
+};
+
+/* A string iterator which charges every move to the budget of the match.
+** Backtracking moves the iterator back and forth, so the steps grow with the
+** amount of backtracking boost does.
+*/
+
+struct BudgetIterator
+{
+    typedef std::bidirectional_iterator_tag iterator_category;
+    typedef wchar_t value_type;
+    typedef std::ptrdiff_t difference_type;
+    typedef const wchar_t *pointer;
+    typedef const wchar_t &reference;
+
+    const wchar_t *pos;
+    MatchBudget *budget;
+
+    BudgetIterator() : pos(NULL), budget(NULL) {}
+    BudgetIterator(const wchar_t *pos, MatchBudget *budget)
+        : pos(pos), budget(budget) {}
+
+    reference operator*() const { return *pos; }
+    pointer operator->() const { return pos; }
+    bool operator==(const BudgetIterator &it) const { return pos == it.pos; }
+    bool operator!=(const BudgetIterator &it) const { return pos != it.pos; }
+
+    BudgetIterator& operator++()
+    {
+        pos++;
+        spendStep(budget);
+        return *this;
+    }
+
+    BudgetIterator& operator--()
+    {
+        pos--;
+        spendStep(budget);
+        return *this;
+    }
+
+    BudgetIterator operator++(int)
+    {
+        BudgetIterator prev(*this);
+        ++*this;
+        return prev;
+    }
+
+    BudgetIterator operator--(int)
+    {
+        BudgetIterator prev(*this);
+        --*this;
+        return prev;
+    }
+
+    static void spendStep(MatchBudget *budget);
+};
+
+static void* compileBoost(const wchar_t *pattern);
+static void* copyBoost(const void *regex);
+static void freeBoost(void *regex);
+static int matchBoost(void *regex, const wchar_t *str);
+static void* compileDfa(const wchar_t *pattern);
+static void* copyDfa(const void *regex);
+static void freeDfa(void *regex);
+static int matchDfa(void *regex, const wchar_t *str);
+
+static const MatchBackend dfaBackend = {
+    L"DFA", compileDfa, copyDfa, freeDfa, matchDfa
+};
+
+static const MatchBackend boostBackend = {
+    L"Boost", compileBoost, copyBoost, freeBoost, matchBoost
+};
 
 int isValidRegex(const wchar_t *pattern)
 {
@@ -29,3 +142,2026 @@ int isRegexMatch(const wchar_t *pattern, const wchar_t *str)
     boost::wregex re(pattern, boost::regex_constants::no_except);
     return !re.status() && boost::regex_match(str, re);
 }
+
+const MatchBackend* getDfaBackend(void)
+{
+    return &dfaBackend;
+}
+
+const MatchBackend* getBoostBackend(void)
+{
+    return &boostBackend;
+}
+
+Matcher* compileMatcher(const wchar_t *pattern)
+{
+    Matcher *matcher;
+
+    /* Boost is only needed for the patterns the DFA doesn't support. */
+
+    if (!(matcher = compileMatcherWith(&dfaBackend, pattern)))
+        matcher = compileMatcherWith(&boostBackend, pattern);
+
+    return matcher;
+}
+
+Matcher* compileMatcherWith(const MatchBackend *backend,
+                            const wchar_t *pattern)
+{
+    Matcher *matcher;
+
+    if (!(matcher = new (std::nothrow) Matcher))
+    {
+        /* TODO error */
+        return NULL;
+    }
+
+    matcher->backend = backend;
+
+    if (!(matcher->regex = backend->compile(pattern)))
+    {
+        /* TODO error */
+        delete matcher;
+        return NULL;
+    }
+
+    return matcher;
+}
+
+Matcher* copyMatcher(const Matcher *matcher)
+{
+    Matcher *copy;
+
+    if (!(copy = new (std::nothrow) Matcher))
+    {
+        /* TODO error */
+        return NULL;
+    }
+
+    copy->backend = matcher->backend;
+
+    if (!(copy->regex = matcher->backend->copy(matcher->regex)))
+    {
+        /* TODO error */
+        delete copy;
+        return NULL;
+    }
+
+    return copy;
+}
+
+void freeMatcher(Matcher *matcher)
+{
+    if (!matcher)
+        return;
+
+    matcher->backend->destroy(matcher->regex);
+    delete matcher;
+}
+
+int isMatch(const Matcher *matcher, const wchar_t *str)
+{
+    return matcher->backend->match(matcher->regex, str);
+}
+
+const MatchBackend* getMatcherBackend(const Matcher *matcher)
+{
+    return matcher->backend;
+}
+
+void* compileBoost(const wchar_t *pattern)
+{
+    boost::wregex *re;
+
+    if (!(re = new (std::nothrow) boost::wregex))
+    {
+        /* TODO error */
+        return NULL;
+    }
+
+    re->assign(pattern, boost::regex_constants::no_except);
+
+    if (re->status())
+    {
+        /* TODO error */
+        delete re;
+        return NULL;
+    }
+
+    return re;
+}
+
+void* copyBoost(const void *regex)
+{
+    /* Copying a boost::wregex only shares the compiled state machine, so
+    ** there's no need to compile the pattern again.
+    */
+
+    return new (std::nothrow) boost::wregex(
+        *static_cast<const boost::wregex*>(regex));
+}
+
+void freeBoost(void *regex)
+{
+    delete static_cast<boost::wregex*>(regex);
+}
+
+int matchBoost(void *regex, const wchar_t *str)
+{
+    MatchBudget budget;
+
+    budget.steps = 0;
+    budget.deadline = std::chrono::steady_clock::now()
+                      + std::chrono::milliseconds(MAX_MATCH_MILLIS);
+
+    /* Boost also gives up on its own on patterns which backtrack too much.
+    ** No exception may reach the C code.
+    */
+
+    try
+    {
+        return boost::regex_match(BudgetIterator(str, &budget),
+                                  BudgetIterator(str + wcslen(str), &budget),
+                                  *static_cast<boost::wregex*>(regex));
+    }
+    catch (...)
+    {
+        /* TODO error */
+        return -1;
+    }
+}
+
+void BudgetIterator::spendStep(MatchBudget *budget)
+{
+    if (++budget->steps > MAX_MATCH_STEPS)
+        throw BudgetExceeded();
+
+    if (!(budget->steps % CLOCK_CHECK_INTERVAL)
+        && std::chrono::steady_clock::now() > budget->deadline)
+    {
+        throw BudgetExceeded();
+    }
+}
+
+int isExponentialRegex(const Matcher *matcher, const wchar_t *pattern)
+{
+    std::vector<unsigned char> groups;
+    const wchar_t *pos;
+    bool quantified;
+    bool lastGroup;
+
+    /* The DFA takes linear time no matter what. */
+
+    if (matcher->backend != &boostBackend)
+        return 0;
+
+    /* Looks for a group containing an unbounded quantifier which is itself
+    ** repeated without bound, e.g. (a+)* or (\w*\\)+. quantified tells
+    ** whether the current group contains an unbounded quantifier, lastGroup
+    ** whether the previous atom is a group which does.
+    */
+
+    quantified = false;
+    lastGroup = false;
+
+    for (pos = pattern; *pos; pos++)
+    {
+        switch (*pos)
+        {
+        case L'\\':
+            if (pos[1])
+                pos++;
+
+            lastGroup = false;
+            break;
+        case L'[':
+            pos++;
+
+            if (*pos == L'^')
+                pos++;
+            if (*pos == L']')
+                pos++;
+
+            while (*pos && *pos != L']')
+            {
+                if (*pos == L'\\' && pos[1])
+                    pos++;
+
+                pos++;
+            }
+
+            if (!*pos)
+                return 0;
+
+            lastGroup = false;
+            break;
+        case L'(':
+            groups.push_back(quantified);
+            quantified = false;
+            lastGroup = false;
+            break;
+        case L')':
+            if (groups.empty())
+                return 0;
+
+            lastGroup = quantified;
+            quantified = quantified || groups.back();
+            groups.pop_back();
+            break;
+        case L'{':
+
+            /* Only {n,} is unbounded. */
+
+            while (iswdigit(pos[1]))
+                pos++;
+
+            if (pos[1] != L',' || pos[2] != L'}')
+            {
+                lastGroup = false;
+                break;
+            }
+
+            pos += 2;
+
+            /* Fall through. */
+
+        case L'*':
+        case L'+':
+            if (lastGroup)
+                return 1;
+
+            quantified = true;
+            break;
+        default:
+            lastGroup = false;
+            break;
+        }
+    }
+
+    return 0;
+}
+
+/******************************************************************************\
+*                                                                             *
+* Rule set matcher                                                            *
+*                                                                             *
+\******************************************************************************/
+
+/* The rule set matcher compiles the regular subset of the Perl syntax, i.e.
+** literals, escaped punctuation, '.', bracket expressions, groups,
+** alternations and the greedy and lazy quantifiers, into a single Thompson
+** NFA. The NFA is run as a DFA whose states, i.e. sets of NFA states, are
+** built lazily while matching and cached, so a string is matched in one pass
+** and mostly without touching the NFA at all. Since regex_match only
+** cares whether the whole string is matched, the language of a pattern is all
+** that matters and the NFA gives the same answer as boost. Patterns using
+** anything else, e.g. back-references, assertions, character class escapes or
+** flags, are matched with their boost matcher instead.
+**
+** Before that, the string is run through an Aho-Corasick automaton of the
+** literals the patterns require, e.g. the extensions in .*\.(c|cpp). Only the
+** patterns whose literals occur take part in the matching.
+**
+** The built-in DFA backend of single matchers is a rule set matcher of one
+** pattern.
+*/
+
+/** The maximum number of NFA states of a single pattern. */
+#define MAX_PATTERN_STATES 4096
+
+/** The maximum bound of a counted repetition, e.g. a{1,MAX_REPEAT}. */
+#define MAX_REPEAT 64
+
+/** No upper bound of a repetition. */
+#define REPEAT_INF ((unsigned int) -1)
+
+/** The start state of a pattern which is matched with boost. */
+#define NO_START ((size_t) -1)
+
+/** The maximum number of alternative literals required by a pattern. */
+#define MAX_LITERALS 16
+
+/** The maximum length of a required literal. */
+#define MAX_LITERAL_LEN 64
+
+/** Bracket expressions with more characters are not expanded to literals. */
+#define MAX_CLASS_LITERALS 4
+
+/** The maximum number of cached DFA states. */
+#define MAX_DFA_STATES 256
+
+/** The maximum number of NFA states in all cached DFA states together. */
+#define MAX_DFA_SET_SIZE 65536
+
+/** Transitions of the DFA are cached for the characters below this. */
+#define DFA_ALPHABET 128
+
+/** The number of slots of the DFA state hash table, a power of 2. */
+#define DFA_TABLE_SIZE (2 * MAX_DFA_STATES)
+
+/** An uncached transition or an empty hash table slot. */
+#define NO_DFA_STATE ((unsigned int) -1)
+
+enum
+{
+    NODE_EMPTY,
+    NODE_RANGE,
+    NODE_CLASS,
+    NODE_CONCAT,
+    NODE_ALT,
+    NODE_REPEAT
+};
+
+enum
+{
+    STATE_RANGE,
+    STATE_CLASS,
+    STATE_SPLIT,
+    STATE_MATCH
+};
+
+typedef struct
+{
+    wchar_t lo;
+    wchar_t hi;
+} Range;
+
+/* A node of the syntax tree of a pattern. The children of concatenations and
+** alternations are stored in ParseCtx::children.
+*/
+
+typedef struct
+{
+    int type;
+    wchar_t lo;
+    wchar_t hi;
+    size_t first;
+    size_t cnt;
+    bool negate;
+    unsigned int min;
+    unsigned int max;
+} Node;
+
+typedef struct
+{
+    int type;
+    wchar_t lo;
+    wchar_t hi;
+    bool negate;
+    size_t first;
+    size_t cnt;
+    size_t out;
+    size_t out1;
+} State;
+
+typedef struct
+{
+    const wchar_t *pos;
+    const wchar_t *end;
+    const wchar_t *pattern;
+    size_t maxStates;
+    std::vector<Node> nodes;
+    std::vector<size_t> children;
+    std::vector<Range> *ranges;
+} ParseCtx;
+
+/* A set of literals, one of which appears in every string matched by a
+** pattern. An empty set means nothing is known.
+*/
+
+typedef std::vector<std::wstring> Literals;
+
+/* A node of the Aho-Corasick automaton. The edges and outputs of the node are
+** stored in RuleSetMatcher::acEdges and RuleSetMatcher::acOutputs. The output
+** link points to the closest node on the failure chain with outputs.
+*/
+
+typedef struct
+{
+    size_t edgeFirst;
+    size_t edgeCnt;
+    size_t outFirst;
+    size_t outCnt;
+    size_t fail;
+    size_t outLink;
+} AcNode;
+
+typedef struct
+{
+    wchar_t ch;
+    size_t next;
+} AcEdge;
+
+/* A literal ending in a node. Suffix literals only count at the end of the
+** string.
+*/
+
+typedef struct
+{
+    size_t pattern;
+    bool suffix;
+} AcOutput;
+
+/* A state of the lazy DFA, i.e. a sorted set of NFA states which consume a
+** character or accept. The NFA states are stored in RuleSetMatcher::dfaSets
+** and the cached transitions in RuleSetMatcher::dfaNext.
+*/
+
+typedef struct
+{
+    size_t first;
+    size_t cnt;
+    size_t hash;
+} DfaState;
+
+struct _RuleSetMatcher
+{
+    size_t cnt;
+    std::vector<State> states;
+    std::vector<Range> ranges;
+    std::vector<size_t> starts;
+    std::vector<const Matcher*> fallbacks;
+    std::vector<AcNode> acNodes;
+    std::vector<AcEdge> acEdges;
+    std::vector<AcOutput> acOutputs;
+    std::vector<unsigned char> filtered;
+    std::vector<unsigned char> candidates;
+    std::vector<size_t> curr;
+    std::vector<size_t> next;
+    std::vector<size_t> stack;
+    std::vector<unsigned int> marks;
+    std::vector<unsigned char> matched;
+    std::vector<unsigned char> aborted;
+    size_t abortedCnt;
+    std::vector<unsigned long long> nanos;
+    size_t patternCnt;
+    std::vector<DfaState> dfaStates;
+    std::vector<size_t> dfaSets;
+    std::vector<unsigned int> dfaNext;
+    std::vector<unsigned int> dfaTable;
+    unsigned long dfaFlushCnt;
+    unsigned int mark;
+};
+
+static bool isEscapable(wchar_t ch);
+static bool parseAlt(ParseCtx *ctx, size_t *node);
+static bool parseConcat(ParseCtx *ctx, size_t *node);
+static bool parseRepeat(ParseCtx *ctx, size_t *node);
+static bool parseAtom(ParseCtx *ctx, size_t *node);
+static bool parseClass(ParseCtx *ctx, size_t *node);
+static bool parseClassChar(ParseCtx *ctx, wchar_t *ch);
+static bool parseCount(ParseCtx *ctx, unsigned int *cnt);
+static size_t addNode(ParseCtx *ctx, int type);
+static bool compileNode(const ParseCtx *ctx,
+                        size_t node,
+                        size_t next,
+                        std::vector<State> *states,
+                        size_t *start);
+static size_t addState(std::vector<State> *states, int type, size_t out);
+static bool getExact(const ParseCtx *ctx, size_t node, Literals *exact);
+static void getSuffixes(const ParseCtx *ctx, size_t node, Literals *suffixes);
+static void getFactors(const ParseCtx *ctx, size_t node, Literals *factors);
+static bool crossLiterals(const Literals &head,
+                          const Literals &tail,
+                          Literals *res);
+static bool unionLiterals(const Literals &src, Literals *dst);
+static bool hasEmptyLiteral(const Literals &literals);
+static size_t getMinLiteralLen(const Literals &literals);
+static bool compilePattern(RuleSetMatcher *matcher,
+                           const wchar_t *pattern,
+                           size_t index,
+                           Literals *literals,
+                           bool *suffix);
+static void buildPrefilter(RuleSetMatcher *matcher,
+                           const std::vector<Literals> &literals,
+                           const std::vector<unsigned char> &suffix);
+static size_t findAcEdge(const RuleSetMatcher *matcher,
+                         size_t node,
+                         wchar_t ch);
+static void runPrefilter(RuleSetMatcher *matcher, const wchar_t *str);
+static void addToList(RuleSetMatcher *matcher,
+                      std::vector<size_t> *list,
+                      size_t state);
+static bool isInClass(const RuleSetMatcher *matcher,
+                      const State *state,
+                      wchar_t ch);
+static void nextMark(RuleSetMatcher *matcher);
+static unsigned int getDfaState(RuleSetMatcher *matcher,
+                                std::vector<size_t> *set);
+static unsigned int stepDfa(RuleSetMatcher *matcher,
+                            unsigned int dfaState,
+                            wchar_t ch);
+static void flushDfa(RuleSetMatcher *matcher);
+static unsigned long long toNanos(std::chrono::steady_clock::duration duration);
+
+bool isEscapable(wchar_t ch)
+{
+    /* Only punctuation is taken literally. Escaped letters and digits have
+    ** special meanings and non-ASCII characters are left to boost as well.
+    ** So are \` and \' which anchor at the buffer boundaries and \< and \>
+    ** which anchor at word boundaries.
+    */
+
+    return ch > L' ' && ch < 0x7F && !iswalnum(ch) && !wcschr(L"`'<>", ch);
+}
+
+bool parseAlt(ParseCtx *ctx, size_t *node)
+{
+    std::vector<size_t> alts;
+    size_t alt;
+    size_t ii;
+
+    for (;;)
+    {
+        if (!parseConcat(ctx, &alt))
+            return false;
+
+        alts.push_back(alt);
+
+        if (ctx->pos == ctx->end || *ctx->pos != L'|')
+            break;
+
+        ctx->pos++;
+    }
+
+    if (alts.size() == 1)
+    {
+        *node = alts[0];
+        return true;
+    }
+
+    *node = addNode(ctx, NODE_ALT);
+    ctx->nodes[*node].first = ctx->children.size();
+    ctx->nodes[*node].cnt = alts.size();
+
+    for (ii = 0; ii < alts.size(); ii++)
+        ctx->children.push_back(alts[ii]);
+
+    return true;
+}
+
+bool parseConcat(ParseCtx *ctx, size_t *node)
+{
+    std::vector<size_t> items;
+    size_t item;
+    size_t ii;
+
+    while (ctx->pos != ctx->end && *ctx->pos != L'|' && *ctx->pos != L')')
+    {
+        if (!parseRepeat(ctx, &item))
+            return false;
+
+        items.push_back(item);
+    }
+
+    if (items.size() == 1)
+    {
+        *node = items[0];
+        return true;
+    }
+
+    *node = addNode(ctx, items.empty() ? NODE_EMPTY : NODE_CONCAT);
+    ctx->nodes[*node].first = ctx->children.size();
+    ctx->nodes[*node].cnt = items.size();
+
+    for (ii = 0; ii < items.size(); ii++)
+        ctx->children.push_back(items[ii]);
+
+    return true;
+}
+
+bool parseRepeat(ParseCtx *ctx, size_t *node)
+{
+    unsigned int min;
+    unsigned int max;
+    size_t atom;
+
+    if (!parseAtom(ctx, &atom))
+        return false;
+
+    if (ctx->pos == ctx->end)
+    {
+        *node = atom;
+        return true;
+    }
+
+    switch (*ctx->pos)
+    {
+    case L'*':
+        min = 0;
+        max = REPEAT_INF;
+        ctx->pos++;
+        break;
+    case L'+':
+        min = 1;
+        max = REPEAT_INF;
+        ctx->pos++;
+        break;
+    case L'?':
+        min = 0;
+        max = 1;
+        ctx->pos++;
+        break;
+    case L'{':
+        ctx->pos++;
+
+        if (!parseCount(ctx, &min))
+            return false;
+
+        max = min;
+
+        if (ctx->pos != ctx->end && *ctx->pos == L',')
+        {
+            ctx->pos++;
+
+            if (ctx->pos != ctx->end && *ctx->pos == L'}')
+                max = REPEAT_INF;
+            else if (!parseCount(ctx, &max) || max < min)
+                return false;
+        }
+
+        if (ctx->pos == ctx->end || *ctx->pos != L'}')
+            return false;
+
+        ctx->pos++;
+        break;
+    default:
+        *node = atom;
+        return true;
+    }
+
+    /* Lazy quantifiers match the same strings. Possessive quantifiers don't,
+    ** so they're left to boost along with stacked quantifiers.
+    */
+
+    if (ctx->pos != ctx->end && *ctx->pos == L'?')
+        ctx->pos++;
+
+    if (ctx->pos != ctx->end
+        && (*ctx->pos == L'*' || *ctx->pos == L'+' || *ctx->pos == L'?'
+            || *ctx->pos == L'{'))
+    {
+        return false;
+    }
+
+    *node = addNode(ctx, NODE_REPEAT);
+    ctx->nodes[*node].first = atom;
+    ctx->nodes[*node].min = min;
+    ctx->nodes[*node].max = max;
+
+    return true;
+}
+
+bool parseAtom(ParseCtx *ctx, size_t *node)
+{
+    wchar_t ch;
+
+    ch = *ctx->pos;
+
+    switch (ch)
+    {
+    case L'(':
+        ctx->pos++;
+
+        /* Only non-capturing groups, everything else starting with "(?" is
+        ** an assertion or a flag.
+        */
+
+        if (ctx->pos != ctx->end && *ctx->pos == L'?')
+        {
+            if (ctx->end - ctx->pos < 2 || ctx->pos[1] != L':')
+                return false;
+
+            ctx->pos += 2;
+        }
+
+        if (!parseAlt(ctx, node)
+            || ctx->pos == ctx->end
+            || *ctx->pos != L')')
+        {
+            return false;
+        }
+
+        ctx->pos++;
+        return true;
+    case L'[':
+        return parseClass(ctx, node);
+    case L'.':
+        ctx->pos++;
+        *node = addNode(ctx, NODE_RANGE);
+        ctx->nodes[*node].lo = 0;
+        ctx->nodes[*node].hi = WCHAR_MAX;
+        return true;
+    case L'^':
+    case L'$':
+
+        /* With regex_match, an anchor at the very beginning or the very end
+        ** of the pattern always holds. Anywhere else it's an assertion.
+        */
+
+        if ((ch == L'^' && ctx->pos != ctx->pattern)
+            || (ch == L'$' && ctx->pos + 1 != ctx->end))
+        {
+            return false;
+        }
+
+        ctx->pos++;
+
+        /* Boost rejects quantified anchors. */
+
+        if (ctx->pos != ctx->end && wcschr(L"*+?{", *ctx->pos))
+            return false;
+
+        *node = addNode(ctx, NODE_EMPTY);
+        return true;
+    case L'\\':
+        if (ctx->pos + 1 == ctx->end || !isEscapable(ctx->pos[1]))
+            return false;
+
+        ch = ctx->pos[1];
+        ctx->pos += 2;
+        break;
+    case L'*':
+    case L'+':
+    case L'?':
+    case L'{':
+    case L'}':
+    case L']':
+        return false;
+    default:
+        ctx->pos++;
+    }
+
+    *node = addNode(ctx, NODE_RANGE);
+    ctx->nodes[*node].lo = ch;
+    ctx->nodes[*node].hi = ch;
+
+    return true;
+}
+
+bool parseClass(ParseCtx *ctx, size_t *node)
+{
+    Range range;
+    size_t first;
+    bool negate;
+
+    ctx->pos++;
+    negate = false;
+
+    if (ctx->pos != ctx->end && *ctx->pos == L'^')
+    {
+        negate = true;
+        ctx->pos++;
+    }
+
+    /* A leading ']' is a literal in some syntaxes and an error in others. */
+
+    if (ctx->pos == ctx->end || *ctx->pos == L']')
+        return false;
+
+    first = ctx->ranges->size();
+
+    while (ctx->pos != ctx->end && *ctx->pos != L']')
+    {
+        /* A '-' is only taken literally at the edges of the expression. */
+
+        if (*ctx->pos == L'-'
+            && ctx->ranges->size() != first
+            && ctx->end - ctx->pos >= 2
+            && ctx->pos[1] != L']')
+        {
+            return false;
+        }
+        if (!parseClassChar(ctx, &range.lo))
+            return false;
+
+        range.hi = range.lo;
+
+        if (ctx->end - ctx->pos >= 2
+            && ctx->pos[0] == L'-'
+            && ctx->pos[1] != L']')
+        {
+            ctx->pos++;
+
+            if (!parseClassChar(ctx, &range.hi) || range.hi < range.lo)
+                return false;
+        }
+
+        ctx->ranges->push_back(range);
+    }
+
+    if (ctx->pos == ctx->end)
+        return false;
+
+    ctx->pos++;
+
+    *node = addNode(ctx, NODE_CLASS);
+    ctx->nodes[*node].first = first;
+    ctx->nodes[*node].cnt = ctx->ranges->size() - first;
+    ctx->nodes[*node].negate = negate;
+
+    return true;
+}
+
+bool parseClassChar(ParseCtx *ctx, wchar_t *ch)
+{
+    /* Character classes like [:alpha:], collating elements and escapes other
+    ** than for punctuation are left to boost.
+    */
+
+    if (ctx->pos == ctx->end || *ctx->pos == L'[')
+        return false;
+
+    if (*ctx->pos == L'\\')
+    {
+        if (ctx->pos + 1 == ctx->end || !isEscapable(ctx->pos[1]))
+            return false;
+
+        ctx->pos++;
+    }
+
+    *ch = *ctx->pos++;
+
+    return true;
+}
+
+bool parseCount(ParseCtx *ctx, unsigned int *cnt)
+{
+    const wchar_t *start;
+
+    start = ctx->pos;
+    *cnt = 0;
+
+    while (ctx->pos != ctx->end && *ctx->pos >= L'0' && *ctx->pos <= L'9')
+    {
+        *cnt = *cnt * 10 + (*ctx->pos++ - L'0');
+
+        if (*cnt > MAX_REPEAT)
+            return false;
+    }
+
+    return ctx->pos != start;
+}
+
+size_t addNode(ParseCtx *ctx, int type)
+{
+    Node node = { type, 0, 0, 0, 0, false, 0, 0 };
+
+    ctx->nodes.push_back(node);
+    return ctx->nodes.size() - 1;
+}
+
+/* Compiles a syntax tree node back to front: the states of the node are
+** created so that they continue with the state next once the node matched.
+*/
+
+bool compileNode(const ParseCtx *ctx,
+                 size_t node,
+                 size_t next,
+                 std::vector<State> *states,
+                 size_t *start)
+{
+    const Node *nn;
+    size_t split;
+    size_t alt;
+    size_t ii;
+
+    if (states->size() > ctx->maxStates)
+        return false;
+
+    nn = &ctx->nodes[node];
+
+    switch (nn->type)
+    {
+    case NODE_EMPTY:
+        *start = next;
+        return true;
+    case NODE_RANGE:
+        *start = addState(states, STATE_RANGE, next);
+        (*states)[*start].lo = nn->lo;
+        (*states)[*start].hi = nn->hi;
+        return true;
+    case NODE_CLASS:
+        *start = addState(states, STATE_CLASS, next);
+        (*states)[*start].first = nn->first;
+        (*states)[*start].cnt = nn->cnt;
+        (*states)[*start].negate = nn->negate;
+        return true;
+    case NODE_CONCAT:
+        for (ii = nn->cnt; ii > 0; ii--)
+        {
+            if (!compileNode(ctx, ctx->children[nn->first + ii - 1], next,
+                             states, &next))
+            {
+                return false;
+            }
+        }
+
+        *start = next;
+        return true;
+    case NODE_ALT:
+        if (!compileNode(ctx, ctx->children[nn->first + nn->cnt - 1], next,
+                         states, start))
+        {
+            return false;
+        }
+
+        for (ii = nn->cnt - 1; ii > 0; ii--)
+        {
+            if (!compileNode(ctx, ctx->children[nn->first + ii - 1], next,
+                             states, &alt))
+            {
+                return false;
+            }
+
+            split = addState(states, STATE_SPLIT, alt);
+            (*states)[split].out1 = *start;
+            *start = split;
+        }
+
+        return true;
+    case NODE_REPEAT:
+
+        /* The optional part is compiled first since it's the tail: either an
+        ** unbounded loop or max - min nested optional copies.
+        */
+
+        if (nn->max == REPEAT_INF)
+        {
+            split = addState(states, STATE_SPLIT, 0);
+            (*states)[split].out1 = next;
+
+            if (!compileNode(ctx, nn->first, split, states, &alt))
+                return false;
+
+            (*states)[split].out = alt;
+            next = split;
+        }
+        else
+        {
+            for (ii = nn->min; ii < nn->max; ii++)
+            {
+                if (!compileNode(ctx, nn->first, next, states, &alt))
+                    return false;
+
+                split = addState(states, STATE_SPLIT, alt);
+                (*states)[split].out1 = next;
+                next = split;
+            }
+        }
+
+        for (ii = 0; ii < nn->min; ii++)
+        {
+            if (!compileNode(ctx, nn->first, next, states, &next))
+                return false;
+        }
+
+        *start = next;
+        return true;
+    }
+
+    return false;
+}
+
+size_t addState(std::vector<State> *states, int type, size_t out)
+{
+    State state = { type, 0, 0, false, 0, 0, out, 0 };
+
+    states->push_back(state);
+    return states->size() - 1;
+}
+
+/* Determines all strings a node matches if there are only a few. */
+
+bool getExact(const ParseCtx *ctx, size_t node, Literals *exact)
+{
+    const Node *nn;
+    const Range *range;
+    Literals child;
+    Literals power;
+    Literals tmp;
+    size_t ii;
+    unsigned int jj;
+    wchar_t ch;
+
+    nn = &ctx->nodes[node];
+    exact->clear();
+
+    switch (nn->type)
+    {
+    case NODE_EMPTY:
+        exact->push_back(std::wstring());
+        return true;
+    case NODE_RANGE:
+        if (nn->hi - nn->lo >= MAX_CLASS_LITERALS)
+            return false;
+
+        for (ch = nn->lo; ch <= nn->hi && ch >= nn->lo; ch++)
+            exact->push_back(std::wstring(1, ch));
+
+        return true;
+    case NODE_CLASS:
+        if (nn->negate)
+            return false;
+
+        for (ii = 0; ii < nn->cnt; ii++)
+        {
+            range = &(*ctx->ranges)[nn->first + ii];
+
+            if (range->hi - range->lo >= MAX_CLASS_LITERALS)
+                return false;
+
+            for (ch = range->lo; ch <= range->hi && ch >= range->lo; ch++)
+            {
+                if (exact->size() == MAX_CLASS_LITERALS)
+                    return false;
+
+                exact->push_back(std::wstring(1, ch));
+            }
+        }
+
+        return true;
+    case NODE_CONCAT:
+        exact->push_back(std::wstring());
+
+        for (ii = 0; ii < nn->cnt; ii++)
+        {
+            if (!getExact(ctx, ctx->children[nn->first + ii], &child)
+                || !crossLiterals(*exact, child, &tmp))
+            {
+                return false;
+            }
+
+            exact->swap(tmp);
+        }
+
+        return true;
+    case NODE_ALT:
+        for (ii = 0; ii < nn->cnt; ii++)
+        {
+            if (!getExact(ctx, ctx->children[nn->first + ii], &child)
+                || !unionLiterals(child, exact))
+            {
+                return false;
+            }
+        }
+
+        return true;
+    case NODE_REPEAT:
+        if (nn->max > MAX_CLASS_LITERALS
+            || !getExact(ctx, nn->first, &child))
+        {
+            return false;
+        }
+
+        power.push_back(std::wstring());
+
+        for (jj = 0; jj <= nn->max; jj++)
+        {
+            if (jj >= nn->min && !unionLiterals(power, exact))
+                return false;
+
+            if (jj < nn->max)
+            {
+                if (!crossLiterals(power, child, &tmp))
+                    return false;
+
+                power.swap(tmp);
+            }
+        }
+
+        return true;
+    }
+
+    return false;
+}
+
+/* Determines the literals one of which every string matched by a node ends
+** with.
+*/
+
+void getSuffixes(const ParseCtx *ctx, size_t node, Literals *suffixes)
+{
+    const Node *nn;
+    Literals child;
+    Literals tmp;
+    size_t ii;
+
+    nn = &ctx->nodes[node];
+    suffixes->clear();
+
+    if (getExact(ctx, node, suffixes))
+    {
+        if (hasEmptyLiteral(*suffixes))
+            suffixes->clear();
+
+        return;
+    }
+
+    suffixes->clear();
+
+    switch (nn->type)
+    {
+    case NODE_CONCAT:
+
+        /* Prepend the exact children from the back until reaching one which
+        ** isn't exact. Its suffixes are prepended as well and that's it.
+        */
+
+        suffixes->push_back(std::wstring());
+
+        for (ii = nn->cnt; ii > 0; ii--)
+        {
+            if (getExact(ctx, ctx->children[nn->first + ii - 1], &child))
+            {
+                if (!crossLiterals(child, *suffixes, &tmp))
+                    break;
+
+                suffixes->swap(tmp);
+            }
+            else
+            {
+                getSuffixes(ctx, ctx->children[nn->first + ii - 1], &child);
+
+                if (!child.empty() && crossLiterals(child, *suffixes, &tmp))
+                    suffixes->swap(tmp);
+
+                break;
+            }
+        }
+
+        break;
+    case NODE_ALT:
+        for (ii = 0; ii < nn->cnt; ii++)
+        {
+            getSuffixes(ctx, ctx->children[nn->first + ii], &child);
+
+            if (child.empty() || !unionLiterals(child, suffixes))
+            {
+                suffixes->clear();
+                return;
+            }
+        }
+
+        break;
+    case NODE_REPEAT:
+        if (nn->min)
+            getSuffixes(ctx, nn->first, suffixes);
+
+        break;
+    }
+
+    if (hasEmptyLiteral(*suffixes))
+        suffixes->clear();
+}
+
+/* Determines the literals one of which every string matched by a node
+** contains. Prefers the literals with the greatest minimal length.
+*/
+
+void getFactors(const ParseCtx *ctx, size_t node, Literals *factors)
+{
+    const Node *nn;
+    Literals child;
+    Literals run;
+    Literals tmp;
+    size_t ii;
+
+    nn = &ctx->nodes[node];
+    factors->clear();
+
+    if (getExact(ctx, node, factors))
+    {
+        if (hasEmptyLiteral(*factors))
+            factors->clear();
+
+        return;
+    }
+
+    factors->clear();
+
+    switch (nn->type)
+    {
+    case NODE_CONCAT:
+
+        /* Consecutive exact children form a run of literals. The best run or
+        ** the best factors of a child which isn't exact win.
+        */
+
+        run.push_back(std::wstring());
+
+        for (ii = 0; ii <= nn->cnt; ii++)
+        {
+            if (ii < nn->cnt
+                && getExact(ctx, ctx->children[nn->first + ii], &child)
+                && crossLiterals(run, child, &tmp))
+            {
+                run.swap(tmp);
+                continue;
+            }
+
+            if (!hasEmptyLiteral(run)
+                && (factors->empty()
+                    || getMinLiteralLen(run) > getMinLiteralLen(*factors)))
+            {
+                factors->swap(run);
+            }
+
+            run.assign(1, std::wstring());
+
+            if (ii == nn->cnt)
+                break;
+
+            /* The child is exact, but the run got too big. */
+
+            if (getExact(ctx, ctx->children[nn->first + ii], &child))
+            {
+                run.swap(child);
+                continue;
+            }
+
+            getFactors(ctx, ctx->children[nn->first + ii], &child);
+
+            if (!child.empty()
+                && (factors->empty()
+                    || getMinLiteralLen(child) > getMinLiteralLen(*factors)))
+            {
+                factors->swap(child);
+            }
+        }
+
+        break;
+    case NODE_ALT:
+        for (ii = 0; ii < nn->cnt; ii++)
+        {
+            getFactors(ctx, ctx->children[nn->first + ii], &child);
+
+            if (child.empty() || !unionLiterals(child, factors))
+            {
+                factors->clear();
+                return;
+            }
+        }
+
+        break;
+    case NODE_REPEAT:
+        if (nn->min)
+            getFactors(ctx, nn->first, factors);
+
+        break;
+    }
+
+    if (hasEmptyLiteral(*factors))
+        factors->clear();
+}
+
+bool crossLiterals(const Literals &head, const Literals &tail, Literals *res)
+{
+    Literals literal(1);
+    size_t ii;
+    size_t jj;
+
+    if (head.size() * tail.size() > MAX_LITERALS)
+        return false;
+
+    res->clear();
+
+    for (ii = 0; ii < head.size(); ii++)
+    {
+        for (jj = 0; jj < tail.size(); jj++)
+        {
+            if (head[ii].size() + tail[jj].size() > MAX_LITERAL_LEN)
+                return false;
+
+            literal[0] = head[ii] + tail[jj];
+            unionLiterals(literal, res);
+        }
+    }
+
+    return true;
+}
+
+bool unionLiterals(const Literals &src, Literals *dst)
+{
+    size_t ii;
+
+    for (ii = 0; ii < src.size(); ii++)
+    {
+        if (std::find(dst->begin(), dst->end(), src[ii]) != dst->end())
+            continue;
+        if (dst->size() == MAX_LITERALS)
+            return false;
+
+        dst->push_back(src[ii]);
+    }
+
+    return true;
+}
+
+bool hasEmptyLiteral(const Literals &literals)
+{
+    return std::find(literals.begin(), literals.end(), std::wstring())
+           != literals.end();
+}
+
+size_t getMinLiteralLen(const Literals &literals)
+{
+    size_t len;
+    size_t ii;
+
+    len = SIZE_MAX;
+
+    for (ii = 0; ii < literals.size(); ii++)
+        len = std::min(len, literals[ii].size());
+
+    return len;
+}
+
+bool compilePattern(RuleSetMatcher *matcher,
+                    const wchar_t *pattern,
+                    size_t index,
+                    Literals *literals,
+                    bool *suffix)
+{
+    ParseCtx ctx;
+    size_t firstState;
+    size_t firstRange;
+    size_t root;
+    size_t match;
+    size_t start;
+
+    firstState = matcher->states.size();
+    firstRange = matcher->ranges.size();
+
+    ctx.pattern = pattern;
+    ctx.pos = pattern;
+    ctx.end = pattern + wcslen(pattern);
+    ctx.ranges = &matcher->ranges;
+    ctx.maxStates = firstState + MAX_PATTERN_STATES;
+
+    if (parseAlt(&ctx, &root) && ctx.pos == ctx.end)
+    {
+        match = addState(&matcher->states, STATE_MATCH, 0);
+        matcher->states[match].first = index;
+
+        if (compileNode(&ctx, root, match, &matcher->states, &start)
+            && matcher->states.size() <= ctx.maxStates)
+        {
+            matcher->starts[index] = start;
+
+            /* Suffixes are checked only at the end of the string, so they
+            ** filter better than factors of the same length.
+            */
+
+            getSuffixes(&ctx, root, literals);
+            *suffix = !literals->empty();
+
+            if (!*suffix)
+                getFactors(&ctx, root, literals);
+
+            return true;
+        }
+    }
+
+    matcher->states.resize(firstState);
+    matcher->ranges.resize(firstRange);
+
+    return false;
+}
+
+void buildPrefilter(RuleSetMatcher *matcher,
+                    const std::vector<Literals> &literals,
+                    const std::vector<unsigned char> &suffix)
+{
+    std::vector<std::map<wchar_t, size_t> > edges;
+    std::vector<std::vector<AcOutput> > outputs;
+    std::map<wchar_t, size_t>::const_iterator it;
+    std::vector<size_t> queue;
+    AcOutput output;
+    AcEdge edge;
+    AcNode *node;
+    size_t fail;
+    size_t curr;
+    size_t ii;
+    size_t jj;
+    size_t kk;
+
+    /* Build the trie of all literals first. */
+
+    edges.resize(1);
+    outputs.resize(1);
+
+    for (ii = 0; ii < literals.size(); ii++)
+    {
+        for (jj = 0; jj < literals[ii].size(); jj++)
+        {
+            curr = 0;
+
+            for (kk = 0; kk < literals[ii][jj].size(); kk++)
+            {
+                it = edges[curr].find(literals[ii][jj][kk]);
+
+                if (it != edges[curr].end())
+                {
+                    curr = it->second;
+                    continue;
+                }
+
+                edges[curr][literals[ii][jj][kk]] = edges.size();
+                curr = edges.size();
+                edges.resize(edges.size() + 1);
+                outputs.resize(outputs.size() + 1);
+            }
+
+            output.pattern = ii;
+            output.suffix = suffix[ii] != 0;
+            outputs[curr].push_back(output);
+        }
+    }
+
+    /* Flatten the trie, then compute the failure and output links in breadth
+    ** first order.
+    */
+
+    matcher->acNodes.resize(edges.size());
+
+    for (ii = 0; ii < edges.size(); ii++)
+    {
+        node = &matcher->acNodes[ii];
+        node->edgeFirst = matcher->acEdges.size();
+        node->edgeCnt = edges[ii].size();
+        node->outFirst = matcher->acOutputs.size();
+        node->outCnt = outputs[ii].size();
+        node->fail = 0;
+        node->outLink = 0;
+
+        for (it = edges[ii].begin(); it != edges[ii].end(); ++it)
+        {
+            edge.ch = it->first;
+            edge.next = it->second;
+            matcher->acEdges.push_back(edge);
+        }
+
+        matcher->acOutputs.insert(matcher->acOutputs.end(),
+                                  outputs[ii].begin(),
+                                  outputs[ii].end());
+    }
+
+    for (it = edges[0].begin(); it != edges[0].end(); ++it)
+        queue.push_back(it->second);
+
+    for (ii = 0; ii < queue.size(); ii++)
+    {
+        curr = queue[ii];
+
+        for (it = edges[curr].begin(); it != edges[curr].end(); ++it)
+        {
+            node = &matcher->acNodes[it->second];
+
+            fail = matcher->acNodes[curr].fail;
+
+            while (fail && findAcEdge(matcher, fail, it->first) == NO_START)
+                fail = matcher->acNodes[fail].fail;
+
+            if ((node->fail = findAcEdge(matcher, fail, it->first))
+                == NO_START)
+            {
+                node->fail = 0;
+            }
+
+            node->outLink = matcher->acNodes[node->fail].outCnt
+                            ? node->fail
+                            : matcher->acNodes[node->fail].outLink;
+
+            queue.push_back(it->second);
+        }
+    }
+
+    for (ii = 0; ii < literals.size(); ii++)
+        matcher->filtered[ii] = !literals[ii].empty();
+}
+
+size_t findAcEdge(const RuleSetMatcher *matcher, size_t node, wchar_t ch)
+{
+    const AcEdge *first;
+    const AcEdge *last;
+    const AcEdge *edge;
+
+    first = &matcher->acEdges[0] + matcher->acNodes[node].edgeFirst;
+    last = first + matcher->acNodes[node].edgeCnt;
+
+    while (first < last)
+    {
+        edge = first + (last - first) / 2;
+
+        if (edge->ch == ch)
+            return edge->next;
+        else if (edge->ch < ch)
+            first = edge + 1;
+        else
+            last = edge;
+    }
+
+    return NO_START;
+}
+
+void runPrefilter(RuleSetMatcher *matcher, const wchar_t *str)
+{
+    const AcNode *node;
+    const AcOutput *output;
+    size_t curr;
+    size_t next;
+    size_t ii;
+
+    for (ii = 0; ii < matcher->cnt; ii++)
+        matcher->candidates[ii] = !matcher->filtered[ii];
+
+    if (matcher->acNodes.size() < 2)
+        return;
+
+    curr = 0;
+
+    for (; *str; str++)
+    {
+        while ((next = findAcEdge(matcher, curr, *str)) == NO_START && curr)
+            curr = matcher->acNodes[curr].fail;
+
+        curr = next == NO_START ? 0 : next;
+
+        for (node = &matcher->acNodes[curr];
+             ;
+             node = &matcher->acNodes[node->outLink])
+        {
+            for (ii = 0; ii < node->outCnt; ii++)
+            {
+                output = &matcher->acOutputs[node->outFirst + ii];
+
+                if (!output->suffix || !str[1])
+                    matcher->candidates[output->pattern] = 1;
+            }
+
+            if (!node->outLink)
+                break;
+        }
+    }
+}
+
+void addToList(RuleSetMatcher *matcher,
+               std::vector<size_t> *list,
+               size_t state)
+{
+    const State *ss;
+
+    /* Follows the epsilon transitions. Only the states which consume a
+    ** character or accept end up in the list. The first branch of a split is
+    ** followed right away, the second one is put on the stack.
+    */
+
+    for (;;)
+    {
+        if (matcher->marks[state] != matcher->mark)
+        {
+            matcher->marks[state] = matcher->mark;
+            ss = &matcher->states[state];
+
+            if (ss->type == STATE_SPLIT)
+            {
+                matcher->stack.push_back(ss->out1);
+                state = ss->out;
+                continue;
+            }
+
+            list->push_back(state);
+        }
+
+        if (matcher->stack.empty())
+            break;
+
+        state = matcher->stack.back();
+        matcher->stack.pop_back();
+    }
+}
+
+bool isInClass(const RuleSetMatcher *matcher, const State *state, wchar_t ch)
+{
+    const Range *range;
+    size_t ii;
+
+    for (ii = 0; ii < state->cnt; ii++)
+    {
+        range = &matcher->ranges[state->first + ii];
+
+        if (ch >= range->lo && ch <= range->hi)
+            return !state->negate;
+    }
+
+    return state->negate;
+}
+
+void nextMark(RuleSetMatcher *matcher)
+{
+    if (!++matcher->mark)
+    {
+        std::fill(matcher->marks.begin(), matcher->marks.end(), 0);
+        matcher->mark = 1;
+    }
+}
+
+unsigned int getDfaState(RuleSetMatcher *matcher, std::vector<size_t> *set)
+{
+    const DfaState *dfaState;
+    DfaState newState;
+    size_t hash;
+    size_t slot;
+    size_t ii;
+
+    /* The same set may be reached in a different order, so sort it to get a
+    ** unique key.
+    */
+
+    std::sort(set->begin(), set->end());
+
+    hash = FNV_OFFSET_BASIS;
+
+    for (ii = 0; ii < set->size(); ii++)
+        hash = FNV_STEP(hash, (*set)[ii]);
+
+    if (matcher->dfaTable.empty())
+        matcher->dfaTable.assign(DFA_TABLE_SIZE, NO_DFA_STATE);
+
+    for (slot = hash & (DFA_TABLE_SIZE - 1);
+         matcher->dfaTable[slot] != NO_DFA_STATE;
+         slot = (slot + 1) & (DFA_TABLE_SIZE - 1))
+    {
+        dfaState = &matcher->dfaStates[matcher->dfaTable[slot]];
+
+        if (dfaState->hash == hash
+            && dfaState->cnt == set->size()
+            && std::equal(set->begin(),
+                          set->end(),
+                          matcher->dfaSets.begin() + dfaState->first))
+        {
+            return matcher->dfaTable[slot];
+        }
+    }
+
+    /* The cache is dropped as a whole once it's full. A single set larger
+    ** than the limit is still added to the empty cache.
+    */
+
+    if (matcher->dfaStates.size() == MAX_DFA_STATES
+        || matcher->dfaSets.size() + set->size() > MAX_DFA_SET_SIZE)
+    {
+        flushDfa(matcher);
+        slot = hash & (DFA_TABLE_SIZE - 1);
+    }
+
+    newState.first = matcher->dfaSets.size();
+    newState.cnt = set->size();
+    newState.hash = hash;
+
+    matcher->dfaSets.insert(matcher->dfaSets.end(), set->begin(), set->end());
+    matcher->dfaNext.resize(matcher->dfaNext.size() + DFA_ALPHABET,
+                            NO_DFA_STATE);
+    matcher->dfaStates.push_back(newState);
+    matcher->dfaTable[slot] = matcher->dfaStates.size() - 1;
+
+    return matcher->dfaTable[slot];
+}
+
+unsigned int stepDfa(RuleSetMatcher *matcher,
+                     unsigned int dfaState,
+                     wchar_t ch)
+{
+    const State *state;
+    unsigned long flushCnt;
+    unsigned int next;
+    size_t first;
+    size_t cnt;
+    size_t ii;
+
+    if (ch < DFA_ALPHABET
+        && (next = matcher->dfaNext[dfaState * DFA_ALPHABET + ch])
+           != NO_DFA_STATE)
+    {
+        return next;
+    }
+
+    first = matcher->dfaStates[dfaState].first;
+    cnt = matcher->dfaStates[dfaState].cnt;
+
+    nextMark(matcher);
+    matcher->next.clear();
+
+    for (ii = 0; ii < cnt; ii++)
+    {
+        state = &matcher->states[matcher->dfaSets[first + ii]];
+
+        if ((state->type == STATE_RANGE
+             && ch >= state->lo && ch <= state->hi)
+            || (state->type == STATE_CLASS
+                && isInClass(matcher, state, ch)))
+        {
+            addToList(matcher, &matcher->next, state->out);
+        }
+    }
+
+    /* The transition can't be cached if the cache was flushed meanwhile,
+    ** the state it leaves from is gone.
+    */
+
+    flushCnt = matcher->dfaFlushCnt;
+    next = getDfaState(matcher, &matcher->next);
+
+    if (ch < DFA_ALPHABET && flushCnt == matcher->dfaFlushCnt)
+        matcher->dfaNext[dfaState * DFA_ALPHABET + ch] = next;
+
+    return next;
+}
+
+void flushDfa(RuleSetMatcher *matcher)
+{
+    matcher->dfaStates.clear();
+    matcher->dfaSets.clear();
+    matcher->dfaNext.clear();
+    std::fill(matcher->dfaTable.begin(), matcher->dfaTable.end(),
+              NO_DFA_STATE);
+    matcher->dfaFlushCnt++;
+}
+
+unsigned long long toNanos(std::chrono::steady_clock::duration duration)
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(duration)
+           .count();
+}
+
+RuleSetMatcher* compileRuleSetMatcher(const wchar_t *const *patterns,
+                                      const Matcher *const *matchers,
+                                      size_t cnt)
+{
+    std::vector<Literals> literals;
+    std::vector<unsigned char> suffix;
+    RuleSetMatcher *matcher;
+    bool isSuffix;
+    size_t ii;
+
+    if (!(matcher = new (std::nothrow) RuleSetMatcher))
+    {
+        /* TODO error */
+        return NULL;
+    }
+
+    try
+    {
+        matcher->cnt = cnt;
+        matcher->mark = 0;
+        matcher->dfaFlushCnt = 0;
+        matcher->starts.assign(cnt, NO_START);
+        matcher->fallbacks.resize(cnt);
+        matcher->filtered.resize(cnt);
+        matcher->candidates.resize(cnt);
+        matcher->matched.resize(cnt);
+        matcher->aborted.resize(cnt);
+        matcher->abortedCnt = 0;
+        matcher->nanos.resize(cnt);
+        matcher->patternCnt = 0;
+        literals.resize(cnt);
+        suffix.resize(cnt);
+
+        for (ii = 0; ii < cnt; ii++)
+        {
+            /* Rules without a regular expression never match here. */
+
+            if (!patterns[ii])
+                continue;
+
+            matcher->patternCnt++;
+            isSuffix = false;
+            matcher->fallbacks[ii] = compilePattern(matcher, patterns[ii], ii,
+                                                    &literals[ii], &isSuffix)
+                                     ? NULL
+                                     : matchers[ii];
+            suffix[ii] = isSuffix;
+        }
+
+        buildPrefilter(matcher, literals, suffix);
+
+        matcher->marks.resize(matcher->states.size());
+        matcher->curr.reserve(matcher->states.size());
+        matcher->next.reserve(matcher->states.size());
+        matcher->stack.reserve(2 * matcher->states.size() + 1);
+    }
+    catch (...)
+    {
+        /* TODO error */
+        delete matcher;
+        return NULL;
+    }
+
+    return matcher;
+}
+
+void freeRuleSetMatcher(RuleSetMatcher *matcher)
+{
+    delete matcher;
+}
+
+size_t matchRuleSet(RuleSetMatcher *matcher,
+                    const wchar_t *str,
+                    size_t *matches)
+{
+    size_t matchCnt;
+    size_t ii;
+
+    matchRuleSetAutomaton(matcher, str, matches);
+
+    matchCnt = 0;
+
+    for (ii = 0; ii < matcher->cnt; ii++)
+    {
+        if (matcher->matched[ii] || matchFallbackPattern(matcher, str, ii))
+            matches[matchCnt++] = ii;
+    }
+
+    return matchCnt;
+}
+
+size_t matchRuleSetAutomaton(RuleSetMatcher *matcher,
+                             const wchar_t *str,
+                             size_t *matches)
+{
+    std::chrono::steady_clock::time_point start;
+    std::chrono::steady_clock::time_point end;
+    unsigned long long shared;
+    const wchar_t *pos;
+    const State *state;
+    const DfaState *dfaState;
+    unsigned int curr;
+    size_t matchCnt;
+    size_t ii;
+
+    start = std::chrono::steady_clock::now();
+
+    /* The lists never hold more states than there are and every state pushes
+    ** at most 2 others on the stack, so the reserved capacity suffices. Only
+    ** DFA states which aren't cached yet allocate memory and the cache is
+    ** bounded.
+    */
+
+    std::fill(matcher->matched.begin(), matcher->matched.end(), 0);
+
+    runPrefilter(matcher, str);
+
+    nextMark(matcher);
+    matcher->curr.clear();
+
+    for (ii = 0; ii < matcher->cnt; ii++)
+    {
+        if (matcher->candidates[ii] && matcher->starts[ii] != NO_START)
+            addToList(matcher, &matcher->curr, matcher->starts[ii]);
+    }
+
+    /* The start state depends on the candidates, so it's looked up for
+    ** every string. The empty set is the dead state.
+    */
+
+    curr = getDfaState(matcher, &matcher->curr);
+
+    for (pos = str; *pos && matcher->dfaStates[curr].cnt; pos++)
+        curr = stepDfa(matcher, curr, *pos);
+
+    if (!*pos)
+    {
+        dfaState = &matcher->dfaStates[curr];
+
+        for (ii = 0; ii < dfaState->cnt; ii++)
+        {
+            state = &matcher->states[matcher->dfaSets[dfaState->first + ii]];
+
+            if (state->type == STATE_MATCH)
+                matcher->matched[state->first] = 1;
+        }
+    }
+
+    /* The combined pass can't be attributed to single patterns, so its time
+    ** is split evenly between all of them.
+    */
+
+    end = std::chrono::steady_clock::now();
+    shared = toNanos(end - start) / std::max<size_t>(matcher->patternCnt, 1);
+    matchCnt = 0;
+
+    for (ii = 0; ii < matcher->cnt; ii++)
+    {
+        matcher->nanos[ii] = shared;
+
+        if (matcher->matched[ii])
+            matches[matchCnt++] = ii;
+    }
+
+    return matchCnt;
+}
+
+int isFallbackPattern(const RuleSetMatcher *matcher, size_t index)
+{
+    return matcher->fallbacks[index] != NULL;
+}
+
+int matchFallbackPattern(RuleSetMatcher *matcher,
+                         const wchar_t *str,
+                         size_t index)
+{
+    std::chrono::steady_clock::time_point start;
+    std::chrono::steady_clock::time_point end;
+    int res;
+
+    /* The prefilter already ran as part of the automaton. */
+
+    if (!matcher->fallbacks[index] || !matcher->candidates[index])
+        return 0;
+
+    start = std::chrono::steady_clock::now();
+    res = isMatch(matcher->fallbacks[index], str);
+    end = std::chrono::steady_clock::now();
+
+    matcher->nanos[index] += toNanos(end - start);
+
+    if (res < 0)
+    {
+        /* A pattern which ran out of its budget once is likely to do so
+        ** again, so it's never matched again.
+        */
+
+        matcher->fallbacks[index] = NULL;
+        matcher->aborted[index] = 1;
+        matcher->abortedCnt++;
+    }
+
+    return res > 0;
+}
+
+size_t getAbortedPatternCount(const RuleSetMatcher *matcher)
+{
+    return matcher->abortedCnt;
+}
+
+int isPatternAborted(const RuleSetMatcher *matcher, size_t index)
+{
+    return matcher->aborted[index];
+}
+
+const unsigned long long* getPatternMatchNanos(const RuleSetMatcher *matcher)
+{
+    return matcher->nanos.data();
+}
+
+void* compileDfa(const wchar_t *pattern)
+{
+    RuleSetMatcher *matcher;
+    const Matcher *fallback;
+
+    fallback = NULL;
+
+    if (!(matcher = compileRuleSetMatcher(&pattern, &fallback, 1)))
+    {
+        /* TODO error */
+        return NULL;
+    }
+
+    /* The pattern needs features of boost. */
+
+    if (matcher->starts[0] == NO_START)
+    {
+        delete matcher;
+        return NULL;
+    }
+
+    return matcher;
+}
+
+void* copyDfa(const void *regex)
+{
+    /* The cached DFA states are copied as well. */
+
+    try
+    {
+        return new RuleSetMatcher(*static_cast<const RuleSetMatcher*>(regex));
+    }
+    catch (...)
+    {
+        /* TODO error */
+        return NULL;
+    }
+}
+
+void freeDfa(void *regex)
+{
+    delete static_cast<RuleSetMatcher*>(regex);
+}
+
+int matchDfa(void *regex, const wchar_t *str)
+{
+    size_t index;
+
+    return matchRuleSet(static_cast<RuleSetMatcher*>(regex), str, &index) > 0;
+}
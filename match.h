@@ -18,6 +18,34 @@ along with this program. If not, see <http://www.gnu.org/licenses/>.
 #ifndef __MATCHER_H__
 #define __MATCHER_H__
 
+/**
+ * An opaque handle to a compiled regular expression. Matchers are compiled
+ * once when the rules are loaded or modified and are reused for every
+ * notification afterwards.
+ */
+typedef struct _Matcher Matcher;
+
+/**
+ * An opaque handle to a number of regular expressions compiled into a single
+ * automaton which checks all of them in one pass over a string.
+ */
+typedef struct _RuleSetMatcher RuleSetMatcher;
+
+/**
+ * A regular expression engine. The compile function returns NULL if the
+ * pattern is invalid, the engine doesn't support it or the memory could not
+ * be allocated. Matching may update caches of the compiled regular
+ * expression, so it must not be used by multiple threads at once.
+ */
+typedef struct
+{
+    const wchar_t *name;
+    void* (*compile)(const wchar_t *pattern);
+    void* (*copy)(const void *regex);
+    void (*destroy)(void *regex);
+    int (*match)(void *regex, const wchar_t *str);
+} MatchBackend;
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -25,6 +53,143 @@ extern "C" {
 int isValidRegex(const wchar_t *pattern);
 int isRegexMatch(const wchar_t *pattern, const wchar_t *str);
 
+/**
+ * Returns the built-in backend. It matches in linear time with a lazily built
+ * DFA, but supports only the regular subset of the syntax, i.e. no
+ * back-references, assertions, character class escapes or flags.
+ */
+const MatchBackend* getDfaBackend(void);
+
+/** Returns the backend which supports the whole syntax using Boost.Regex. */
+const MatchBackend* getBoostBackend(void);
+
+/**
+ * Compiles a regular expression into a matcher. The DFA backend is used if it
+ * supports the pattern, the boost backend otherwise.
+ * \param pattern the regular expression to compile.
+ * \return the compiled matcher or NULL if the pattern is invalid or the
+ *         memory could not be allocated.
+ */
+Matcher* compileMatcher(const wchar_t *pattern);
+
+/**
+ * Compiles a regular expression into a matcher using a specific backend.
+ * \param backend the backend to use.
+ * \param pattern the regular expression to compile.
+ * \return the compiled matcher or NULL if the pattern is invalid, the backend
+ *         doesn't support it or the memory could not be allocated.
+ */
+Matcher* compileMatcherWith(const MatchBackend *backend,
+                            const wchar_t *pattern);
+
+/**
+ * Creates a copy of a compiled matcher without recompiling the pattern.
+ * \param matcher the matcher to copy.
+ * \return the copy or NULL if the memory could not be allocated.
+ */
+Matcher* copyMatcher(const Matcher *matcher);
+
+void freeMatcher(Matcher *matcher);
+/**
+ * Checks whether a string is matched by a compiled regular expression.
+ * \param matcher the compiled regular expression.
+ * \param str the string to check.
+ * \return 1 if the whole string is matched, 0 if not and -1 if the backend
+ *         gave up, e.g. because of excessive backtracking. Boost gives up
+ *         after a fixed number of steps or a fixed time.
+ */
+int isMatch(const Matcher *matcher, const wchar_t *str);
+const MatchBackend* getMatcherBackend(const Matcher *matcher);
+
+/**
+ * Checks whether matching a compiled regular expression may take exponential
+ * time. This is the case if boost matches it and it repeats a group
+ * containing an unbounded quantifier without bound, e.g. (a+)*.
+ * \param matcher the compiled regular expression.
+ * \param pattern the regular expression.
+ * \return non-zero if the regular expression may be slow, 0 otherwise.
+ */
+int isExponentialRegex(const Matcher *matcher, const wchar_t *pattern);
+
+/**
+ * Compiles a number of regular expressions into a rule set matcher. Patterns
+ * which the combined automaton doesn't support are matched with their
+ * compiled matcher instead, so the matchers must outlive the rule set
+ * matcher. A NULL pattern never matches.
+ * \param patterns the regular expressions.
+ * \param matchers the compiled matchers of the regular expressions.
+ * \param cnt the number of regular expressions.
+ * \return the rule set matcher or NULL if the memory could not be allocated.
+ */
+RuleSetMatcher* compileRuleSetMatcher(const wchar_t *const *patterns,
+                                      const Matcher *const *matchers,
+                                      size_t cnt);
+
+void freeRuleSetMatcher(RuleSetMatcher *matcher);
+
+/**
+ * Checks a string against all regular expressions of a rule set matcher.
+ * \param matcher the rule set matcher.
+ * \param str the string to check.
+ * \param matches receives the indices of the matching regular expressions in
+ *        ascending order. Must have room for all of them.
+ * \return the number of matching regular expressions.
+ */
+size_t matchRuleSet(RuleSetMatcher *matcher,
+                    const wchar_t *str,
+                    size_t *matches);
+
+/**
+ * Runs only the combined automaton of a rule set matcher, i.e. the first half
+ * of matchRuleSet. The patterns the automaton doesn't support can then be
+ * matched one by one with matchFallbackPattern, in any order and only as far
+ * as needed.
+ * \param matcher the rule set matcher.
+ * \param str the string to check.
+ * \param matches receives the indices of the patterns matched by the
+ *        automaton in ascending order. Must have room for all patterns.
+ * \return the number of patterns matched by the automaton.
+ */
+size_t matchRuleSetAutomaton(RuleSetMatcher *matcher,
+                             const wchar_t *str,
+                             size_t *matches);
+
+/**
+ * Checks whether a pattern of a rule set matcher is matched on its own
+ * instead of by the combined automaton.
+ */
+int isFallbackPattern(const RuleSetMatcher *matcher, size_t index);
+
+/**
+ * Matches a pattern which isn't part of the combined automaton against the
+ * string passed to the last call to matchRuleSetAutomaton.
+ * \param matcher the rule set matcher.
+ * \param str the string passed to matchRuleSetAutomaton.
+ * \param index the index of the pattern.
+ * \return non-zero if the pattern matches, 0 if not or if it's matched by the
+ *         automaton.
+ */
+int matchFallbackPattern(RuleSetMatcher *matcher,
+                         const wchar_t *str,
+                         size_t index);
+
+/**
+ * Returns the number of regular expressions of a rule set matcher which were
+ * aborted because matching them took too long. Aborted regular expressions
+ * never match again.
+ */
+size_t getAbortedPatternCount(const RuleSetMatcher *matcher);
+
+int isPatternAborted(const RuleSetMatcher *matcher, size_t index);
+
+/**
+ * Returns the time in nanoseconds spent on each regular expression during the
+ * last call to matchRuleSet. The time of the combined automaton is split
+ * evenly between all regular expressions; those matched on their own are
+ * charged their own time on top.
+ */
+const unsigned long long* getPatternMatchNanos(const RuleSetMatcher *matcher);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,237 @@
+/*
+This file is part of NppEventExec
+Copyright (C) 2016-2017 Mihail Ivanchev
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "base.h"
+#include "mem.h"
+#include "util.h"
+#include "hash.h"
+#include "match_cache.h"
+
+/** The maximum number of cached results. */
+#define CAPACITY 128
+
+/** The number of hash buckets, a power of 2. */
+#define BUCKET_CNT 256
+
+typedef struct _Entry
+{
+    size_t hash;
+    unsigned int event;
+    wchar_t *path;
+    size_t *matches;
+    size_t matchCnt;
+    struct _Entry *hashNext;
+    struct _Entry *prev;
+    struct _Entry *next;
+} Entry;
+
+static size_t hashKey(unsigned int event, const wchar_t *path);
+static void linkFirst(Entry *entry);
+static void unlinkEntry(Entry *entry);
+static void removeEntry(Entry *entry);
+
+static Entry *buckets[BUCKET_CNT];
+static Entry *first;
+static Entry *last;
+static size_t entryCnt;
+static unsigned long cacheGen;
+static unsigned long long hits;
+static unsigned long long misses;
+
+int lookupMatches(unsigned long gen,
+                  unsigned int event,
+                  const wchar_t *path,
+                  const size_t **matches,
+                  size_t *matchCnt)
+{
+    Entry *entry;
+    size_t hash;
+
+    assert(path);
+    assert(matches);
+    assert(matchCnt);
+
+    if (gen != cacheGen)
+    {
+        clearMatchCache();
+        cacheGen = gen;
+    }
+
+    hash = hashKey(event, path);
+
+    for (entry = buckets[hash & (BUCKET_CNT - 1)];
+         entry;
+         entry = entry->hashNext)
+    {
+        if (entry->hash == hash
+            && entry->event == event
+            && !wcscmp(entry->path, path))
+        {
+            unlinkEntry(entry);
+            linkFirst(entry);
+            *matches = entry->matches;
+            *matchCnt = entry->matchCnt;
+            hits++;
+            return 1;
+        }
+    }
+
+    misses++;
+    return 0;
+}
+
+int cacheMatches(unsigned int event,
+                 const wchar_t *path,
+                 const size_t *matches,
+                 size_t matchCnt)
+{
+    Entry *entry;
+    Entry **bucket;
+
+    assert(path);
+    assert(matches || !matchCnt);
+
+    if (matchCnt > SIZE_MAX / sizeof *matches)
+    {
+        /* TODO error */
+        goto fail_too_many;
+    }
+    if (!(entry = allocMem(sizeof *entry)))
+    {
+        /* TODO error */
+        goto fail_alloc;
+    }
+    if (!(entry->path = copyStr(path)))
+    {
+        /* TODO error */
+        goto fail_path;
+    }
+
+    entry->matches = NULL;
+
+    if (matchCnt)
+    {
+        if (!(entry->matches = allocMem(matchCnt * sizeof *matches)))
+        {
+            /* TODO error */
+            goto fail_matches;
+        }
+
+        memcpy(entry->matches, matches, matchCnt * sizeof *matches);
+    }
+
+    if (entryCnt == CAPACITY)
+        removeEntry(last);
+
+    entry->hash = hashKey(event, path);
+    entry->event = event;
+    entry->matchCnt = matchCnt;
+
+    bucket = &buckets[entry->hash & (BUCKET_CNT - 1)];
+    entry->hashNext = *bucket;
+    *bucket = entry;
+
+    linkFirst(entry);
+    entryCnt++;
+
+    return 0;
+
+fail_matches:
+    freeStr(entry->path);
+fail_path:
+    freeMem(entry);
+fail_alloc:
+fail_too_many:
+    return 1;
+}
+
+void clearMatchCache(void)
+{
+    while (first)
+        removeEntry(first);
+}
+
+void getMatchCacheStats(unsigned long long *hitCnt,
+                        unsigned long long *missCnt)
+{
+    assert(hitCnt);
+    assert(missCnt);
+
+    *hitCnt = hits;
+    *missCnt = misses;
+}
+
+size_t hashKey(unsigned int event, const wchar_t *path)
+{
+    size_t hash;
+
+    /* FNV-1a over the event and the code units of the path. */
+
+    hash = FNV_STEP(FNV_OFFSET_BASIS, event);
+
+    while (*path)
+        hash = FNV_STEP(hash, *path++);
+
+    return hash;
+}
+
+void linkFirst(Entry *entry)
+{
+    entry->prev = NULL;
+    entry->next = first;
+
+    if (first)
+        first->prev = entry;
+    else
+        last = entry;
+
+    first = entry;
+}
+
+void unlinkEntry(Entry *entry)
+{
+    if (entry->prev)
+        entry->prev->next = entry->next;
+    else
+        first = entry->next;
+
+    if (entry->next)
+        entry->next->prev = entry->prev;
+    else
+        last = entry->prev;
+}
+
+void removeEntry(Entry *entry)
+{
+    Entry **link;
+
+    assert(entry);
+
+    link = &buckets[entry->hash & (BUCKET_CNT - 1)];
+
+    while (*link != entry)
+        link = &(*link)->hashNext;
+
+    *link = entry->hashNext;
+
+    unlinkEntry(entry);
+    entryCnt--;
+
+    freeMem(entry->matches);
+    freeStr(entry->path);
+    freeMem(entry);
+}
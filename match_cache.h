@@ -0,0 +1,66 @@
+/*
+This file is part of NppEventExec
+Copyright (C) 2016-2017 Mihail Ivanchev
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef __MATCH_CACHE_H__
+#define __MATCH_CACHE_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Looks up the rules which matched a path on an event the last time. The
+ * whole cache is dropped first if the rules were changed in the meantime.
+ * \param gen the generation of the rule table, see RuleTable::gen.
+ * \param event the code of the event, e.g. NPPN_FILESAVED.
+ * \param path the path of the buffer.
+ * \param matches receives the indices of the matching rules in the rule table.
+ *        The array stays valid until the next call to a function of the
+ *        cache.
+ * \param matchCnt receives the number of matching rules.
+ * \return non-zero if the result was cached, 0 otherwise.
+ */
+int lookupMatches(unsigned long gen,
+                  unsigned int event,
+                  const wchar_t *path,
+                  const size_t **matches,
+                  size_t *matchCnt);
+
+/**
+ * Stores the rules which matched a path on an event. Has to be preceded by an
+ * unsuccessful call to lookupMatches() for the same event and path. Evicts the
+ * least recently used result if the cache is full.
+ * \param event the code of the event, e.g. NPPN_FILESAVED.
+ * \param path the path of the buffer.
+ * \param matches the indices of the matching rules in the rule table.
+ * \param matchCnt the number of matching rules.
+ * \return 0 upon success, non-zero otherwise.
+ */
+int cacheMatches(unsigned int event,
+                 const wchar_t *path,
+                 const size_t *matches,
+                 size_t matchCnt);
+
+void clearMatchCache(void);
+void getMatchCacheStats(unsigned long long *hitCnt,
+                        unsigned long long *missCnt);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __MATCH_CACHE_H__ */
@@ -55,8 +55,12 @@ void* reallocMem(void *mem, size_t numBytes)
     }
 
 #ifdef DEBUG
-    allocatedBytes -= (unsigned long) prevSize;
-    allocatedBytes += (unsigned long) numBytes;
+    /* The regexes are compiled by worker threads as well. LONG has the size
+    ** of unsigned long on Windows and the sum wraps around alike.
+    */
+
+    InterlockedExchangeAdd((volatile LONG*) &allocatedBytes,
+                           (LONG) (numBytes - prevSize));
 #endif
 
     return res;
@@ -73,7 +77,8 @@ void freeMem(void *mem)
         return;
 
 #ifdef DEBUG
-    allocatedBytes -= (unsigned long) HeapSize(GetProcessHeap(), 0, mem);
+    InterlockedExchangeAdd((volatile LONG*) &allocatedBytes,
+                           -(LONG) HeapSize(GetProcessHeap(), 0, mem));
 #endif
 
     HeapFree(GetProcessHeap(), 0, mem);
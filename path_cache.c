@@ -0,0 +1,239 @@
+/*
+This file is part of NppEventExec
+Copyright (C) 2016-2017 Mihail Ivanchev
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "base.h"
+#include "Scintilla.h"
+#include "Notepad_plus_msgs.h"
+#include "mem.h"
+#include "plugin.h"
+#include "util.h"
+#include "path_cache.h"
+
+/** The number of hash buckets, a power of 2. */
+#define BUCKET_CNT 64
+
+typedef struct _Entry
+{
+    uptr_t bufId;
+    wchar_t *path;
+    wchar_t *canonical;
+    struct _Entry *next;
+} Entry;
+
+static Entry* getEntry(uptr_t bufId);
+static size_t hashBufId(uptr_t bufId);
+static Entry** findEntry(uptr_t bufId);
+static void removeEntry(Entry **link);
+static wchar_t* queryPath(uptr_t bufId);
+#ifdef DEBUG
+static void checkPath(const Entry *entry);
+#endif
+
+static Entry *buckets[BUCKET_CNT];
+
+const wchar_t* getBufferPath(uptr_t bufId)
+{
+    Entry *entry;
+
+    return (entry = getEntry(bufId)) ? entry->path : NULL;
+}
+
+const wchar_t* getCanonicalBufferPath(uptr_t bufId)
+{
+    Entry *entry;
+
+    if (!(entry = getEntry(bufId)))
+    {
+        /* TODO error */
+        return NULL;
+    }
+
+    /* Computed on the first request only, most buffers never need it. */
+
+    if (!entry->canonical
+        && !(entry->canonical = canonicalizePath(entry->path)))
+    {
+        /* TODO error */
+        return NULL;
+    }
+
+    return entry->canonical;
+}
+
+void updatePathCache(uptr_t bufId, unsigned int event)
+{
+    Entry **link;
+
+    /* The path is not queried right away because the event might have no
+    ** rules. Dropping the entry is enough, the next call to getBufferPath()
+    ** fetches the new path.
+    */
+
+    switch (event)
+    {
+    case NPPN_FILEOPENED:
+    case NPPN_FILERENAMED:
+    case NPPN_FILESAVED:
+    case NPPN_FILECLOSED:
+        if (*(link = findEntry(bufId)))
+            removeEntry(link);
+        break;
+    }
+}
+
+void clearPathCache(void)
+{
+    size_t ii;
+
+    for (ii = 0; ii < BUCKET_CNT; ii++)
+    {
+        while (buckets[ii])
+            removeEntry(&buckets[ii]);
+    }
+}
+
+Entry* getEntry(uptr_t bufId)
+{
+    Entry **link;
+    Entry *entry;
+
+    link = findEntry(bufId);
+
+    if (*link)
+    {
+#ifdef DEBUG
+        checkPath(*link);
+#endif
+        return *link;
+    }
+
+    if (!(entry = allocMem(sizeof *entry)))
+    {
+        /* TODO error */
+        goto fail_alloc;
+    }
+    if (!(entry->path = queryPath(bufId)))
+    {
+        /* TODO error */
+        goto fail_query;
+    }
+
+    entry->canonical = NULL;
+    entry->bufId = bufId;
+    entry->next = NULL;
+    *link = entry;
+
+    return entry;
+
+fail_query:
+    freeMem(entry);
+fail_alloc:
+    return NULL;
+}
+
+size_t hashBufId(uptr_t bufId)
+{
+    /* Buffer IDs are pointers in Notepad++, so the low bits are mostly 0. */
+
+    return (size_t) (bufId ^ bufId >> 4 ^ bufId >> 10) & (BUCKET_CNT - 1);
+}
+
+Entry** findEntry(uptr_t bufId)
+{
+    Entry **link;
+
+    link = &buckets[hashBufId(bufId)];
+
+    while (*link && (*link)->bufId != bufId)
+        link = &(*link)->next;
+
+    return link;
+}
+
+void removeEntry(Entry **link)
+{
+    Entry *entry;
+
+    assert(link);
+    assert(*link);
+
+    entry = *link;
+    *link = entry->next;
+    freeStr(entry->path);
+    freeStr(entry->canonical);
+    freeMem(entry);
+}
+
+wchar_t* queryPath(uptr_t bufId)
+{
+    LRESULT unitCnt;
+    size_t unitCntSizeT;
+    wchar_t *path;
+
+    unitCnt = sendNppMsg(NPPM_GETFULLPATHFROMBUFFERID,
+                         (WPARAM) bufId,
+                         (LPARAM) NULL);
+
+    /* Let's not assume that Notepad++ keeps the path string in a contiguous
+    ** region of memory in a zero-terminated fashion. The conversion to size_t
+    ** for the validation is based on the fact that conversion to an unsigned
+    ** integer is always defined behaviour.
+    */
+
+    unitCntSizeT = (size_t) unitCnt;
+
+    if ((LRESULT) unitCntSizeT != unitCnt || unitCntSizeT == SIZE_MAX)
+    {
+        /* TODO error */
+        return NULL;
+    }
+    if (!(path = allocStr(unitCntSizeT + 1)))
+    {
+        /* TODO error */
+        return NULL;
+    }
+
+    sendNppMsg(NPPM_GETFULLPATHFROMBUFFERID, (WPARAM) bufId, (LPARAM) path);
+
+    return path;
+}
+
+#ifdef DEBUG
+
+/* Compares a cached path with the path Notepad++ currently reports for the
+** buffer. A mismatch means a lifecycle event which changes the path is not
+** handled by updatePathCache().
+*/
+
+void checkPath(const Entry *entry)
+{
+    wchar_t *path;
+
+    if (!(path = queryPath(entry->bufId)))
+        return;
+
+    if (wcscmp(path, entry->path))
+    {
+        wprintf(L"Stale cached path for buffer %lu: %ls instead of %ls\r\n",
+                (unsigned long) entry->bufId, entry->path, path);
+        assert(false);
+    }
+
+    freeStr(path);
+}
+
+#endif /* ifdef DEBUG */
@@ -0,0 +1,60 @@
+/*
+This file is part of NppEventExec
+Copyright (C) 2016-2017 Mihail Ivanchev
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef __PATH_CACHE_H__
+#define __PATH_CACHE_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Returns the path of a buffer. The path is queried from Notepad++ the first
+ * time and then served from the cache until the buffer is renamed, saved,
+ * reopened or closed.
+ * \param bufId the ID of the buffer.
+ * \return the path which stays valid until the next call to updatePathCache()
+ *         or clearPathCache(), or NULL upon an error.
+ */
+const wchar_t* getBufferPath(uptr_t bufId);
+
+/**
+ * Returns the canonical form of the path of a buffer as computed by
+ * canonicalizePath(). It's derived from the cached path on the first request
+ * and dropped together with it.
+ * \param bufId the ID of the buffer.
+ * \return the canonical path which stays valid until the next call to
+ *         updatePathCache() or clearPathCache(), or NULL upon an error.
+ */
+const wchar_t* getCanonicalBufferPath(uptr_t bufId);
+
+/**
+ * Keeps the cache in sync with the file lifecycle events. Has to be called
+ * before the rules of an event are executed except for NPPN_FILECLOSED, in
+ * which case the rules should still see the cached path.
+ * \param bufId the ID of the buffer the event was sent for.
+ * \param event the code of the event, e.g. NPPN_FILESAVED.
+ */
+void updatePathCache(uptr_t bufId, unsigned int event);
+
+void clearPathCache(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __PATH_CACHE_H__ */
@@ -0,0 +1,243 @@
+/*
+This file is part of NppEventExec
+Copyright (C) 2016-2017 Mihail Ivanchev
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "base.h"
+#include "util.h"
+#include "hash.h"
+#include "path_scan.h"
+
+/* The vector paths assume 16-bit code units, which is always the case on
+** Windows. SSE2 is part of every x64 CPU; 32-bit builds only get it if the
+** compiler targets it anyway.
+*/
+
+#if WCHAR_MAX == 0xFFFF \
+    && (defined(__SSE2__) || defined(_M_X64) \
+        || (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+#define USE_SSE2
+#endif
+
+#ifdef USE_SSE2
+
+#include <emmintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+/** The number of code units in a vector. */
+#define LANES 8
+
+/** The mask of movemask() when every lane is set. */
+#define ALL_LANES 0xFFFF
+
+static __m128i load(const wchar_t *str);
+static int separatorMask(__m128i vec);
+static int foldAscii(__m128i vec, __m128i *folded);
+static unsigned int lowestLane(int mask);
+static unsigned int highestLane(int mask);
+
+#endif /* ifdef USE_SSE2 */
+
+const wchar_t* findSeparator(const wchar_t *str, const wchar_t *end)
+{
+#ifdef USE_SSE2
+    int mask;
+#endif
+
+    assert(str <= end);
+
+#ifdef USE_SSE2
+    for (; end - str >= LANES; str += LANES)
+    {
+        if ((mask = separatorMask(load(str))))
+            return str + lowestLane(mask);
+    }
+#endif
+
+    while (str < end && !IS_PATH_SEPARATOR(*str))
+        str++;
+
+    return str;
+}
+
+const wchar_t* findLastSeparator(const wchar_t *str, const wchar_t *end)
+{
+#ifdef USE_SSE2
+    int mask;
+#endif
+
+    assert(str <= end);
+
+#ifdef USE_SSE2
+    for (; end - str >= LANES; end -= LANES)
+    {
+        if ((mask = separatorMask(load(end - LANES))))
+            return end - LANES + highestLane(mask);
+    }
+#endif
+
+    while (end > str && !IS_PATH_SEPARATOR(end[-1]))
+        end--;
+
+    return end > str ? end - 1 : NULL;
+}
+
+void foldPathRange(wchar_t *dest, const wchar_t *src, size_t len)
+{
+#ifdef USE_SSE2
+    __m128i folded;
+    size_t ii;
+
+    /* Vectors with a non-ASCII code unit take the scalar path, only
+    ** CharLowerW knows how to fold them.
+    */
+
+    for (; len >= LANES; len -= LANES, src += LANES, dest += LANES)
+    {
+        if (foldAscii(load(src), &folded))
+        {
+            _mm_storeu_si128((__m128i*) dest, folded);
+        }
+        else
+        {
+            for (ii = 0; ii < LANES; ii++)
+                dest[ii] = foldPathChar(src[ii]);
+        }
+    }
+#endif
+
+    for (; len; len--)
+        *dest++ = foldPathChar(*src++);
+}
+
+int isFoldedRange(const wchar_t *folded, const wchar_t *str, size_t len)
+{
+#ifdef USE_SSE2
+    __m128i vec;
+    size_t ii;
+
+    for (; len >= LANES; len -= LANES, folded += LANES, str += LANES)
+    {
+        if (foldAscii(load(str), &vec))
+        {
+            if (_mm_movemask_epi8(_mm_cmpeq_epi16(vec, load(folded)))
+                != ALL_LANES)
+            {
+                return 0;
+            }
+        }
+        else
+        {
+            for (ii = 0; ii < LANES; ii++)
+            {
+                if (folded[ii] != foldPathChar(str[ii]))
+                    return 0;
+            }
+        }
+    }
+#endif
+
+    for (; len; len--)
+    {
+        if (*folded++ != foldPathChar(*str++))
+            return 0;
+    }
+
+    return 1;
+}
+
+size_t hashFoldedRange(size_t hash, const wchar_t *str, size_t len)
+{
+    for (; len; len--)
+        hash = FNV_STEP(hash, foldPathChar(*str++));
+
+    return hash;
+}
+
+#ifdef USE_SSE2
+
+__m128i load(const wchar_t *str)
+{
+    return _mm_loadu_si128((const __m128i*) str);
+}
+
+int separatorMask(__m128i vec)
+{
+    return _mm_movemask_epi8(
+        _mm_or_si128(_mm_cmpeq_epi16(vec, _mm_set1_epi16(L'\\')),
+                     _mm_cmpeq_epi16(vec, _mm_set1_epi16(L'/'))));
+}
+
+int foldAscii(__m128i vec, __m128i *folded)
+{
+    __m128i upper;
+    __m128i backslash;
+
+    /* Only ASCII code units have no bits above the lowest 7. */
+
+    if (_mm_movemask_epi8(
+            _mm_cmpeq_epi16(_mm_and_si128(vec, _mm_set1_epi16(~0x7F)),
+                            _mm_setzero_si128()))
+        != ALL_LANES)
+    {
+        return 0;
+    }
+
+    /* The signed comparisons are safe for ASCII. Like foldPathChar, the
+    ** upper case letters get the bit of the lower case ones and backslashes
+    ** become slashes.
+    */
+
+    upper = _mm_and_si128(_mm_cmpgt_epi16(vec, _mm_set1_epi16(L'A' - 1)),
+                          _mm_cmplt_epi16(vec, _mm_set1_epi16(L'Z' + 1)));
+    backslash = _mm_cmpeq_epi16(vec, _mm_set1_epi16(L'\\'));
+
+    vec = _mm_or_si128(vec, _mm_and_si128(upper, _mm_set1_epi16(0x20)));
+    vec = _mm_xor_si128(vec, _mm_and_si128(backslash,
+                                           _mm_set1_epi16(L'\\' ^ L'/')));
+
+    *folded = vec;
+    return 1;
+}
+
+/* movemask() yields two bits per code unit. */
+
+unsigned int lowestLane(int mask)
+{
+#ifdef _MSC_VER
+    unsigned long bit;
+
+    _BitScanForward(&bit, (unsigned long) mask);
+    return (unsigned int) bit / 2;
+#else
+    return (unsigned int) __builtin_ctz((unsigned int) mask) / 2;
+#endif
+}
+
+unsigned int highestLane(int mask)
+{
+#ifdef _MSC_VER
+    unsigned long bit;
+
+    _BitScanReverse(&bit, (unsigned long) mask);
+    return (unsigned int) bit / 2;
+#else
+    return (unsigned int) (31 - __builtin_clz((unsigned int) mask)) / 2;
+#endif
+}
+
+#endif /* ifdef USE_SSE2 */
@@ -0,0 +1,77 @@
+/*
+This file is part of NppEventExec
+Copyright (C) 2016-2017 Mihail Ivanchev
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef __PATH_SCAN_H__
+#define __PATH_SCAN_H__
+
+/* Scanning primitives for the paths handed out by Notepad++. The functions
+** work on ranges of UTF-16 code units and use SSE2 where the compiler
+** supports it, a scalar loop otherwise. Both \ and / are separators.
+*/
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Finds the first separator in a range.
+ * \param str the start of the range.
+ * \param end the end of the range.
+ * \return the separator or end if the range has none.
+ */
+const wchar_t* findSeparator(const wchar_t *str, const wchar_t *end);
+
+/**
+ * Finds the last separator in a range.
+ * \param str the start of the range.
+ * \param end the end of the range.
+ * \return the separator or NULL if the range has none.
+ */
+const wchar_t* findLastSeparator(const wchar_t *str, const wchar_t *end);
+
+/**
+ * Applies foldPathChar to every code unit of a range.
+ * \param dest receives the folded code units, may be equal to src.
+ * \param src the range to fold.
+ * \param len the length of the range.
+ */
+void foldPathRange(wchar_t *dest, const wchar_t *src, size_t len);
+
+/**
+ * Compares a range with one which has already been folded.
+ * \param folded the folded range.
+ * \param str the range to compare, it's folded on the fly.
+ * \param len the length of both ranges.
+ * \return non-zero if folding str yields folded, 0 otherwise.
+ */
+int isFoldedRange(const wchar_t *folded, const wchar_t *str, size_t len);
+
+/**
+ * Mixes the folded code units of a range into an FNV-1a hash, see hash.h.
+ * Ranges which fold alike hash alike.
+ * \param hash the hash so far, FNV_OFFSET_BASIS for a new one.
+ * \param str the range to hash.
+ * \param len the length of the range.
+ * \return the updated hash.
+ */
+size_t hashFoldedRange(size_t hash, const wchar_t *str, size_t len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __PATH_SCAN_H__ */
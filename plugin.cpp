@@ -21,28 +21,49 @@ along with this program. If not, see <http://www.gnu.org/licenses/>.
 #include "mem.h"
 #include "match.h"
 #include "rule.h"
+#include "rule_table.h"
+#include "match_cache.h"
+#include "exclusion.h"
 #include "edit_dlg.h"
 #include "rules_dlg.h"
 #include "util.h"
 #include "Scintilla.h"
 #include "exec.h"
+#include "rate_limit.h"
+#include "path_cache.h"
 #include "resource.h"
 #include "about_dlg.h"
 #include "queue_dlg.h"
 #include "PluginInterface.h"
 #include "nppexec_msgs.h"
 
+/** The name of the exclusion list in the configuration directory. */
+#define EXCLUSIONS_FILENAME PLUGIN_NAME L"_exclusions.txt"
+
 #ifdef DEBUG
 #include <time.h>
+
+/** The number of notifications simulated by the dispatch benchmark. */
+#define BENCH_NOTIFICATION_CNT 1000
 #endif
 
 static void initPlugin(NppData data);
 static void deinitPlugin(void);
 static bool validateModuleName(wchar_t **dir);
 static wchar_t* queryConfigDir(void);
+static int readExclusions(void);
+static int splitPath(const wchar_t *path,
+                     unsigned int needed,
+                     const wchar_t **targets,
+                     wchar_t **dir);
 static void onEditRules(void);
 static void onExecQueue(void);
+static void onStatistics(void);
 static void onAbout(void);
+static void disableSlowRules(const RuleBucket *bucket);
+#ifdef DEBUG
+static void benchRules(void);
+#endif
 
 static wchar_t *pluginDir;
 static wchar_t *configDir;
@@ -53,12 +74,17 @@ static const TCHAR NPP_PLUGIN_NAME[] = PLUGIN_NAME;
 static FuncItem menuItems[] = {
     { L"Edit rules...", onEditRules },
     { L"Execution queue...", onExecQueue },
+    { L"Statistics...", onStatistics },
     { L"", NULL }, // Separator
     { L"About...", onAbout }
 };
 static bool nppExecLoaded;
 static bool initFailed;
 static Rule *rules;
+static RuleTable *ruleTable;
+static unsigned long long skippedNotifCnt;
+static unsigned long long dispatchedNotifCnt;
+static unsigned long long excludedNotifCnt;
 
 void initPlugin(NppData data)
 {
@@ -88,10 +114,30 @@ void initPlugin(NppData data)
                     L"function until the issues are resolved.");
         goto fail_rules;
     }
+    if (readExclusions())
+    {
+        /* TODO error */
+        errorMsgBox(NULL,
+                    L"Failed to read the exclusion list. The plugin will not "
+                    L"function until the issues are resolved.");
+        goto fail_exclusions;
+    }
+    if (!(ruleTable = buildRuleTable(rules)))
+    {
+        /* TODO error */
+        errorMsgBox(NULL,
+                    L"Failed to prepare the rules for execution. The plugin "
+                    L"will not function until the issues are resolved.");
+        goto fail_table;
+    }
 
     initFailed = false;
     return;
 
+fail_table:
+    clearExclusions();
+fail_exclusions:
+    freeRules(rules);
 fail_rules:
     freeStr(configDir);
 fail_config:
@@ -102,6 +148,12 @@ fail_mod:
 
 void deinitPlugin(void)
 {
+    cancelDeferredExecs();
+    freeQueueMemory();
+    clearMatchCache();
+    clearPathCache();
+    freeRuleTable(ruleTable);
+    clearExclusions();
     freeRules(rules);
     freeStr(configDir);
     freeStr(pluginDir);
@@ -250,6 +302,23 @@ fail_alloc:
     return NULL;
 }
 
+int readExclusions(void)
+{
+    wchar_t *path;
+    int res;
+
+    if (!(path = combinePaths(configDir, EXCLUSIONS_FILENAME)))
+    {
+        /* TODO error */
+        return 1;
+    }
+
+    res = loadExclusions(path);
+    freeStr(path);
+
+    return res;
+}
+
 bool queryNppExecLoaded(void)
 {
     DWORD ver;
@@ -259,62 +328,268 @@ bool queryNppExecLoaded(void)
 
 void execRules(uptr_t bufId, unsigned int code)
 {
-    LRESULT unitCnt;
-    size_t unitCntSizeT;
-    wchar_t *path;
-
-    unitCnt = sendNppMsg(NPPM_GETFULLPATHFROMBUFFERID,
-                         static_cast<WPARAM>(bufId),
-                         static_cast<LPARAM>(NULL));
+    const wchar_t *inputs[MATCH_INPUT_CNT];
+    const wchar_t *path;
+    const wchar_t *canonical;
+    wchar_t *dir;
+    wchar_t *canonicalDir;
+    RuleBucket *bucket;
+    const size_t *matches;
+    size_t *newMatches;
+    unsigned long long *nanos;
+    RuleStats *stats;
+    Rule **matchedRules;
+    wchar_t *execPath;
+    unsigned long gen;
+    size_t matchCnt;
+    size_t ii;
 
-    /* Let's not assume that Notepad++ keeps the path string in a contiguous
-    ** region of memory in a zero-terminated fashion. The conversion to size_t
-    ** for the validation is based on the fact that conversion to an unsigned
-    ** integer is always defined behaviour.
+    /* Most notifications have no rules at all, so they are dismissed before
+    ** querying the path.
     */
 
-    unitCntSizeT = static_cast<size_t>(unitCnt);
+    if (!isEventSubscribed(ruleTable, code))
+    {
+        skippedNotifCnt++;
+        return;
+    }
 
-    if (static_cast<LRESULT>(unitCntSizeT) != unitCnt
-        || unitCntSizeT == SIZE_MAX)
+    if (!(path = getBufferPath(bufId)))
     {
         /* TODO error */
-        goto fail_path_too_long;
+        return;
+    }
+
+    /* Excluded paths are dismissed before any rule is evaluated. */
+
+    if (isPathExcluded(path))
+    {
+        excludedNotifCnt++;
+        return;
     }
-    if (!(path = allocStr(unitCntSizeT + 1)))
+
+    dispatchedNotifCnt++;
+
+    bucket = NULL;
+    newMatches = NULL;
+
+    if (!lookupMatches(ruleTable->gen, code, path, &matches, &matchCnt))
+    {
+        /* Only the enabled rules of the event are stored in its bucket. The
+        ** bucket can't be empty, otherwise the event wouldn't be subscribed.
+        */
+
+        bucket = getRuleBucket(ruleTable, code);
+
+        if (!(newMatches = static_cast<size_t*>(
+                  allocMem(bucket->cnt * sizeof *newMatches))))
+        {
+            /* TODO error */
+            return;
+        }
+        if (!(nanos = static_cast<unsigned long long*>(
+                  allocMem(bucket->cnt * sizeof *nanos))))
+        {
+            /* TODO error */
+            freeMem(newMatches);
+            return;
+        }
+
+        /* The targets are split off the path once for all rules, the
+        ** canonical path is only looked at if a rule asks for it.
+        */
+
+        if (splitPath(path, bucket->inputs, inputs, &dir))
+        {
+            /* TODO error */
+            freeMem(nanos);
+            freeMem(newMatches);
+            return;
+        }
+
+        canonicalDir = NULL;
+
+        if (bucket->inputs >> MATCH_TARGET_CNT
+            && (!(canonical = getCanonicalBufferPath(bufId))
+                || splitPath(canonical,
+                             bucket->inputs >> MATCH_TARGET_CNT,
+                             &inputs[MATCH_TARGET_CNT],
+                             &canonicalDir)))
+        {
+            /* TODO error */
+            freeStr(dir);
+            freeMem(nanos);
+            freeMem(newMatches);
+            return;
+        }
+
+        matchCnt = matchRuleBucket(ruleTable, bucket, inputs, newMatches,
+                                   nanos);
+
+        freeStr(canonicalDir);
+        freeStr(dir);
+
+        for (ii = 0; ii < bucket->cnt; ii++)
+        {
+            if (nanos[ii] == RULE_NOT_EVALUATED)
+                continue;
+
+            stats = &ruleTable->rules[bucket->first + ii]->stats;
+            stats->evalCnt++;
+            stats->totalNanos += nanos[ii];
+            stats->maxNanos = MAX(stats->maxNanos, nanos[ii]);
+        }
+
+        /* Only evaluated rules can match, so the matches are counted here
+        ** rather than for the ones remembered by the cache.
+        */
+
+        for (ii = 0; ii < matchCnt; ii++)
+            ruleTable->rules[newMatches[ii]]->stats.matchCnt++;
+
+        freeMem(nanos);
+
+        if (cacheMatches(code, path, newMatches, matchCnt))
+        {
+            /* TODO error */
+        }
+
+        matches = newMatches;
+    }
+
+    /* Executing a foreground rule opens the queue dialog, whose message loop
+    ** handles notifications as well. They can evict the path and the matches
+    ** from their caches or replace the rule table, so the path and the rules
+    ** are resolved before the first rule is executed.
+    */
+
+    gen = ruleTable->gen;
+    matchedRules = NULL;
+
+    if (!(execPath = copyStr(path))
+        || !(matchedRules = static_cast<Rule**>(
+                 allocMem(matchCnt * sizeof *matchedRules))))
     {
         /* TODO error */
-        goto fail_alloc;
+        freeStr(execPath);
+        freeMem(newMatches);
+        return;
     }
 
-    sendNppMsg(NPPM_GETFULLPATHFROMBUFFERID,
-               static_cast<WPARAM>(bufId),
-               reinterpret_cast<LPARAM>(path));
+    for (ii = 0; ii < matchCnt; ii++)
+        matchedRules[ii] = ruleTable->rules[matches[ii]];
 
-    for (Rule *rule = rules; rule; rule = rule->next)
+    for (ii = 0; ii < matchCnt; ii++)
     {
-        if (rule->event == code
-            && rule->enabled
-            && isRegexMatch(rule->regex, path))
+        if (execLimitedRule(bufId, execPath, matchedRules[ii]))
         {
-            if (execRule(bufId, path, rule))
-            {
-                /* TODO error */
-            }
+            /* TODO error */
         }
     }
 
-    freeStr(path);
-    return;
+    freeMem(matchedRules);
+    freeStr(execPath);
+    freeMem(newMatches);
 
-fail_alloc:
-fail_path_too_long:
-    return;
+    /* The rules whose regexes took too long to match are disabled once the
+    ** matches were executed, since replacing the table invalidates them. The
+    ** bucket is gone if the table was replaced in the meantime.
+    */
+
+    if (bucket && ruleTable->gen == gen && getAbortedEntryCount(bucket))
+        disableSlowRules(bucket);
+}
+
+int splitPath(const wchar_t *path,
+              unsigned int needed,
+              const wchar_t **targets,
+              wchar_t **dir)
+{
+    const wchar_t *filename;
+    const wchar_t *ext;
+    size_t len;
+
+    /* The filename and the extension point into the path, only the directory
+    ** is copied and only if it's needed.
+    */
+
+    filename = getFilename(path);
+    ext = wcsrchr(filename, L'.');
+
+    targets[MATCH_TARGET_PATH] = path;
+    targets[MATCH_TARGET_FILENAME] = filename;
+    targets[MATCH_TARGET_EXT] = ext ? ext + 1 : L"";
+    targets[MATCH_TARGET_DIR] = NULL;
+
+    *dir = NULL;
+
+    if (!(needed & 1U << MATCH_TARGET_DIR))
+        return 0;
+
+    len = filename > path ? filename - path - 1 : 0;
+
+    if (!(*dir = allocStr(len + 1)))
+    {
+        /* TODO error */
+        return 1;
+    }
+
+    wmemcpy(*dir, path, len);
+    (*dir)[len] = L'\0';
+
+    targets[MATCH_TARGET_DIR] = *dir;
+
+    return 0;
+}
+
+void disableSlowRules(const RuleBucket *bucket)
+{
+    RuleTable *oldTable;
+    RuleTable *newTable;
+    size_t ii;
+
+    /* The rules are only disabled in memory, the user can enable them again
+    ** in the rule management dialog. Patterns of the bucket without a regex
+    ** are never aborted.
+    */
+
+    for (ii = 0; ii < bucket->cnt; ii++)
+    {
+        if (isEntryAborted(ruleTable, bucket, ii))
+            ruleTable->rules[bucket->first + ii]->enabled = 0;
+    }
+
+    if (!(newTable = buildRuleTable(rules)))
+    {
+        /* TODO error */
+        return;
+    }
+
+    /* The new table is in place before the message boxes are shown, since
+    ** they dispatch notifications.
+    */
+
+    oldTable = ruleTable;
+    ruleTable = newTable;
+
+    for (ii = 0; ii < bucket->cnt; ii++)
+    {
+        if (isEntryAborted(oldTable, bucket, ii))
+        {
+            msgBox(MB_OK | MB_ICONWARNING, nppWnd,
+                   PLUGIN_NAME L": Rule disabled",
+                   L"The rule \"%ls\" was disabled due to slow matching. Its "
+                   L"regular expression took too long to match a path.",
+                   oldTable->rules[bucket->first + ii]->name);
+        }
+    }
+
+    freeRuleTable(oldTable);
 }
 
 void onEditRules(void)
 {
-    if (openRulesDlg(&rules))
+    if (openRulesDlg(&rules, &ruleTable))
     {
         /* TODO error */
         errorMsgBox(nppWnd, L"Failed to open the rule management dialog.");
@@ -330,6 +605,64 @@ void onExecQueue(void)
     }
 }
 
+void onStatistics(void)
+{
+    ExclusionStats exclusions;
+    ExecStats execs;
+    unsigned long long hitCnt;
+    unsigned long long missCnt;
+    unsigned long long passCnt;
+    unsigned long long deferredCnt;
+    unsigned long long supersededCnt;
+
+    getMatchCacheStats(&hitCnt, &missCnt);
+    getRateLimitStats(&deferredCnt, &supersededCnt);
+    getExclusionStats(&exclusions);
+    getExecStats(&execs);
+
+    /* The false positive rate is measured among the prefixes which aren't
+    ** excluded, only those can be false positives.
+    */
+
+    passCnt = exclusions.lookupCnt - exclusions.excludedCnt;
+
+    msgBox(MB_OK | MB_ICONINFORMATION, nppWnd, PLUGIN_NAME L": Statistics",
+           L"Notifications without rules: %llu\n"
+           L"Notifications dispatched to rules: %llu\n"
+           L"Notifications for excluded paths: %llu\n"
+           L"Match cache hits: %llu (%.1f%%)\n"
+           L"Match cache misses: %llu\n"
+           L"\n"
+           L"Excluded path prefixes: %lu\n"
+           L"Exclusion list memory: %lu bytes\n"
+           L"Exclusion lookups: %llu\n"
+           L"Bloom filter false positives: %llu (%.4f%%, expected %.4f%%)\n"
+           L"\n"
+           L"Executions started: %llu\n"
+           L"Executions coalesced: %llu\n"
+           L"Executions deferred by rate limits: %llu (%llu superseded)\n"
+           L"Average wait in the queue: %.1f ms\n"
+           L"Maximum wait in the queue: %.1f ms\n"
+           L"Completions reported by NppExec: %llu\n"
+           L"NppExec state polls: %llu",
+           skippedNotifCnt, dispatchedNotifCnt, excludedNotifCnt,
+           hitCnt, hitCnt ? 100.0 * hitCnt / (hitCnt + missCnt) : 0.0,
+           missCnt,
+           (unsigned long) exclusions.prefixCnt,
+           (unsigned long) exclusions.memSize,
+           exclusions.lookupCnt,
+           exclusions.falsePositiveCnt,
+           passCnt ? 100.0 * exclusions.falsePositiveCnt / passCnt : 0.0,
+           100.0 * exclusions.expectedFpRate,
+           execs.startCnt,
+           execs.mergeCnt,
+           deferredCnt, supersededCnt,
+           execs.startCnt ? execs.totalWaitNanos / 1e6 / execs.startCnt : 0.0,
+           execs.maxWaitNanos / 1e6,
+           execs.resultCnt,
+           execs.pollCnt);
+}
+
 void onAbout(void)
 {
     openAboutDlg();
@@ -401,6 +734,52 @@ BOOL APIENTRY DllMain(HINSTANCE inst,
 
 #ifdef DEBUG
 
+/* Measures the matching cost of a single notification for all loaded rules,
+** once compiling every regex on the spot like the plugin used to and once
+** with the matchers compiled at load time.
+*/
+
+void benchRules(void)
+{
+    const wchar_t *path = L"C:\\Users\\foo\\Documents\\main.cpp";
+    LARGE_INTEGER freq;
+    LARGE_INTEGER start;
+    LARGE_INTEGER end;
+    unsigned int matchCnt;
+    unsigned int ii;
+    Rule *rule;
+
+    QueryPerformanceFrequency(&freq);
+
+    matchCnt = 0;
+    QueryPerformanceCounter(&start);
+
+    for (ii = 0; ii < BENCH_NOTIFICATION_CNT; ii++)
+    {
+        for (rule = rules; rule; rule = rule->next)
+            matchCnt += isRegexMatch(rule->regex, path);
+    }
+
+    QueryPerformanceCounter(&end);
+    printf("Compiled per notification: %.0f ns/notification (%u matches)\n",
+           (end.QuadPart - start.QuadPart) * 1e9 / freq.QuadPart
+           / BENCH_NOTIFICATION_CNT, matchCnt);
+
+    matchCnt = 0;
+    QueryPerformanceCounter(&start);
+
+    for (ii = 0; ii < BENCH_NOTIFICATION_CNT; ii++)
+    {
+        for (rule = rules; rule; rule = rule->next)
+            matchCnt += isMatch(rule->matcher, path) > 0;
+    }
+
+    QueryPerformanceCounter(&end);
+    printf("Compiled on load:          %.0f ns/notification (%u matches)\n",
+           (end.QuadPart - start.QuadPart) * 1e9 / freq.QuadPart
+           / BENCH_NOTIFICATION_CNT, matchCnt);
+}
+
 LRESULT CALLBACK WndProc(HWND wnd, UINT msg, WPARAM wp, LPARAM lp)
 {
     wchar_t *path;
@@ -428,6 +807,8 @@ LRESULT CALLBACK WndProc(HWND wnd, UINT msg, WPARAM wp, LPARAM lp)
     case WM_KEYDOWN:
         if (wp == VK_ESCAPE)
             DestroyWindow(wnd);
+        else if (wp == VK_F2)
+            benchRules();
         else
         {
             for (rule = rules; rule; rule = rule->next)
@@ -500,6 +881,7 @@ int main(int argc, char *argv[])
     configDir = copyStr(L"config");
     pluginDir = copyStr(L".");
     readRules(&rules);
+    ruleTable = buildRuleTable(rules);
     printRules(rules);
 
     WNDCLASSEXW wcex;
@@ -608,9 +990,19 @@ void beNotified(SCNotification *notification)
     else if (!isPluginInit())
         return;
 
+    /* The rules executed on NPPN_FILECLOSED still need the path of the file,
+    ** so the buffer is evicted from the path cache afterwards.
+    */
+
+    if (hdr->code != NPPN_FILECLOSED)
+        updatePathCache(hdr->idFrom, hdr->code);
+
     if (nppExecLoaded)
         execRules(hdr->idFrom, hdr->code);
 
+    if (hdr->code == NPPN_FILECLOSED)
+        updatePathCache(hdr->idFrom, hdr->code);
+
     if (hdr->code == NPPN_SHUTDOWN)
     {
         if (!isQueueEmpty()
@@ -639,6 +1031,21 @@ void beNotified(SCNotification *notification)
 
 LRESULT messageProc(UINT msg, WPARAM wp, LPARAM lp)
 {
+    CommunicationInfo *ci;
+
+    /* NppExec notifies the plugin once a script it was asked to run has
+    ** finished. Other plugins could send the same message ID.
+    */
+
+    if (msg == NPPM_MSGTOPLUGIN
+        && (ci = reinterpret_cast<CommunicationInfo*>(lp))
+        && ci->internalMsg == NPEN_RESULT
+        && ci->srcModuleName
+        && !_wcsicmp(ci->srcModuleName, NPPEXEC_PLUGIN_MODULE))
+    {
+        onExecResult();
+    }
+
     return TRUE;
 }
 
@@ -0,0 +1,131 @@
+/*
+This file is part of NppEventExec
+Copyright (C) 2016-2017 Mihail Ivanchev
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "base.h"
+#include "mem.h"
+#include "pool.h"
+
+/** The alignment of the objects, the same as for memory from the heap. */
+#define ALIGNMENT MEMORY_ALLOCATION_ALIGNMENT
+
+#define ALIGN(size) (((size) + ALIGNMENT - 1) & ~((size_t) ALIGNMENT - 1))
+
+/* A slab starts with this header, the objects follow at the next aligned
+** offset. Free objects store the pointer to the next free object in place.
+*/
+
+typedef struct _PoolSlab
+{
+    struct _PoolSlab *next;
+} PoolSlab;
+
+static bool addSlab(Pool *pool);
+static size_t getSlotSize(const Pool *pool);
+
+void* allocFromPool(Pool *pool)
+{
+    void *obj;
+
+    assert(pool->objSize);
+    assert(pool->objsPerSlab);
+
+    if (!pool->freeObjs && !addSlab(pool))
+    {
+        /* TODO error */
+        return NULL;
+    }
+
+    obj = pool->freeObjs;
+    pool->freeObjs = *(void**) obj;
+    pool->usedCnt++;
+
+    return obj;
+}
+
+void freeToPool(Pool *pool, void *obj)
+{
+    if (!obj)
+        return;
+
+    assert(pool->usedCnt);
+
+    *(void**) obj = pool->freeObjs;
+    pool->freeObjs = obj;
+    pool->usedCnt--;
+}
+
+void clearPool(Pool *pool)
+{
+    PoolSlab *slab;
+
+    assert(!pool->usedCnt);
+
+    while ((slab = pool->slabs))
+    {
+        pool->slabs = slab->next;
+        freeMem(slab);
+    }
+
+    pool->freeObjs = NULL;
+    pool->slabCnt = 0;
+}
+
+bool addSlab(Pool *pool)
+{
+    PoolSlab *slab;
+    char *obj;
+    size_t slotSize;
+    size_t ii;
+
+    slotSize = getSlotSize(pool);
+
+    if (slotSize > (SIZE_MAX - ALIGN(sizeof *slab)) / pool->objsPerSlab)
+    {
+        /* TODO error */
+        return false;
+    }
+    if (!(slab = allocMem(ALIGN(sizeof *slab)
+                          + pool->objsPerSlab * slotSize)))
+    {
+        /* TODO error */
+        return false;
+    }
+
+    slab->next = pool->slabs;
+    pool->slabs = slab;
+    pool->slabCnt++;
+
+    /* The objects are chained in their order in the slab, so the ones used
+    ** together are close to each other.
+    */
+
+    obj = (char*) slab + ALIGN(sizeof *slab) + pool->objsPerSlab * slotSize;
+
+    for (ii = 0; ii < pool->objsPerSlab; ii++)
+    {
+        obj -= slotSize;
+        *(void**) obj = pool->freeObjs;
+        pool->freeObjs = obj;
+    }
+
+    return true;
+}
+
+size_t getSlotSize(const Pool *pool)
+{
+    return ALIGN(MAX(pool->objSize, sizeof(void*)));
+}
@@ -0,0 +1,69 @@
+/*
+This file is part of NppEventExec
+Copyright (C) 2016-2017 Mihail Ivanchev
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef __POOL_H__
+#define __POOL_H__
+
+/**
+ * A pool of objects of a fixed size. The objects are carved out of slabs of
+ * objsPerSlab objects each and returned objects are reused before a new slab
+ * is allocated, so the heap is only touched once per slab. The slabs are kept
+ * until the pool is cleared.
+ */
+typedef struct
+{
+    size_t objSize;
+    size_t objsPerSlab;
+    void *freeObjs;
+    struct _PoolSlab *slabs;
+    size_t slabCnt;
+    size_t usedCnt;
+} Pool;
+
+/** Initializes a pool statically, no slab is allocated until it's needed. */
+#define POOL_INITIALIZER(objSize, objsPerSlab) \
+    { (objSize), (objsPerSlab), NULL, NULL, 0, 0 }
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Takes an object from the pool. It's aligned like memory from the heap.
+ * \param pool the pool.
+ * \return the object or NULL upon an error.
+ */
+void* allocFromPool(Pool *pool);
+
+/**
+ * Returns an object to the pool it was taken from.
+ * \param pool the pool.
+ * \param obj the object, may be NULL.
+ */
+void freeToPool(Pool *pool, void *obj);
+
+/**
+ * Frees the slabs of the pool. All objects have to be returned beforehand.
+ * \param pool the pool.
+ */
+void clearPool(Pool *pool);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __POOL_H__ */
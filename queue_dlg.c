@@ -84,7 +84,8 @@ typedef enum
     COL_RULE,
     COL_STATE,
     COL_PATH,
-    COL_BACKGROUND
+    COL_BACKGROUND,
+    COL_MERGED
 } Column;
 
 static INT_PTR CALLBACK dlgProc(HWND dlg, UINT msg, WPARAM wp, LPARAM lp);
@@ -98,6 +99,7 @@ static void onOdsStateChanged(NMLVODSTATECHANGE *nmosc);
 static void onQueueAdd(bool foreground);
 static void onQueueRemove(bool foreground);
 static void onQueueStatusUpdate(void);
+static void onQueueMerge(void);
 static void layoutDlg(void);
 static void enlargePosEntries(unsigned int count);
 static void compactPosEntries(void);
@@ -171,6 +173,9 @@ void processQueueEvent(QueueEvent event)
     case QUEUE_STATUS_UPDATE:
         onQueueStatusUpdate();
         break;
+    case QUEUE_MERGE:
+        onQueueMerge();
+        break;
     }
 }
 
@@ -269,6 +274,7 @@ void onInitDlg(HWND handle)
         {COL_STATE, L"State"},
         {COL_PATH, L"Path"},
         {COL_BACKGROUND, L"Background?"},
+        {COL_MERGED, L"Merged"},
         {-1}
     });
 
@@ -396,6 +402,10 @@ void onGetDispInfo(NMLVDISPINFO *dispInfo)
     case COL_BACKGROUND:
         item->pszText = BOOL_TO_STR_YES_NO(!isExecForeground(pos));
         break;
+    case COL_MERGED:
+        StringCchPrintfW(item->pszText, item->cchTextMax, L"%u",
+                         getExecMergeCount(pos));
+        break;
     }
 }
 
@@ -527,10 +537,61 @@ void onOdsStateChanged(NMLVODSTATECHANGE *nmosc)
 
 void onQueueAdd(bool foreground)
 {
+    unsigned int pos;
+    int focused;
+    int first;
+    int last;
+
     dlg->queueSize++;
     dlg->foregroundCnt += foreground;
     enlargePosEntries(dlg->queueSize);
     ListView_SetItemCount(dlg->lvQueue, dlg->queueSize);
+
+    /* Executions of a higher priority are inserted before the ones waiting
+    ** already, so the focus and the selection after it are moved along. Only
+    ** the selected items are visited, usually there are none.
+    */
+
+    pos = getLastAddedExecPos();
+
+    if (pos == dlg->queueSize - 1)
+        return;
+
+    focused = ListView_GetNextItem(dlg->lvQueue, -1, LVNI_FOCUSED);
+
+    if (focused >= (int) pos)
+    {
+        ListView_SetItemState(dlg->lvQueue,
+                              focused + 1,
+                              LVIS_FOCUSED,
+                              LVIS_FOCUSED);
+    }
+
+    /* A run of selected items is moved by deselecting its first item and
+    ** selecting the one after its last item, which wasn't selected.
+    */
+
+    first = (int) pos - 1;
+
+    while ((first = ListView_GetNextItem(dlg->lvQueue, first, LVNI_SELECTED))
+           != -1)
+    {
+        last = first;
+
+        while (ListView_GetNextItem(dlg->lvQueue, last, LVNI_SELECTED)
+               == last + 1)
+        {
+            last++;
+        }
+
+        ListView_SetItemState(dlg->lvQueue, first, 0, LVIS_SELECTED);
+        ListView_SetItemState(dlg->lvQueue,
+                              last + 1,
+                              LVIS_SELECTED,
+                              LVIS_SELECTED);
+
+        first = last + 1;
+    }
 }
 
 void onQueueRemove(bool foreground)
@@ -591,6 +652,13 @@ void onQueueStatusUpdate(void)
     ListView_Update(dlg->lvQueue, 0);
 }
 
+void onQueueMerge(void)
+{
+    /* Any of the queued executions might have been merged into. */
+
+    InvalidateRect(dlg->lvQueue, NULL, FALSE);
+}
+
 void layoutDlg(void)
 {
     RECT dlgRc;
@@ -605,10 +673,11 @@ void layoutDlg(void)
 
     sizeListViewColumns(dlg->lvQueue, (ListViewColumnSize[]) {
         {COL_POS, 0.08},
-        {COL_RULE, 0.25},
-        {COL_STATE, 0.15},
-        {COL_PATH, 0.40},
-        {COL_BACKGROUND, 0.12},
+        {COL_RULE, 0.23},
+        {COL_STATE, 0.13},
+        {COL_PATH, 0.36},
+        {COL_BACKGROUND, 0.10},
+        {COL_MERGED, 0.10},
         {-1}
     });
 }
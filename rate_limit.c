@@ -0,0 +1,247 @@
+/*
+This file is part of NppEventExec
+Copyright (C) 2016-2017 Mihail Ivanchev
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "base.h"
+#include "rule.h"
+#include "Scintilla.h"
+#include "exec.h"
+#include "mem.h"
+#include "util.h"
+#include "rate_limit.h"
+
+/* A rule gets an entry while its rate window is running, i.e. while its timer
+** is set. The entry holds the deferred execution, if any. There are few rate
+** limited rules, so a list is enough.
+*/
+
+typedef struct _Entry
+{
+    Rule *rule;
+    UINT_PTR timerId;
+    uptr_t bufId;
+    wchar_t *path;
+    struct _Entry *next;
+} Entry;
+
+static int runRule(uptr_t bufId, const wchar_t *path, Rule *rule);
+static int deferExec(Entry *entry, uptr_t bufId, const wchar_t *path);
+static void CALLBACK timerProc(HWND wnd,
+                               UINT msg,
+                               UINT_PTR timerId,
+                               DWORD sysTime);
+static Entry** findEntry(const Rule *rule);
+static Entry* createEntry(Rule *rule);
+static void removeEntry(Entry **link);
+
+static Entry *entries;
+static unsigned long long deferredCnt;
+static unsigned long long supersededCnt;
+
+int execLimitedRule(uptr_t bufId, const wchar_t *path, Rule *rule)
+{
+    Entry **link;
+    UINT_PTR timerId;
+
+    assert(path);
+    assert(rule);
+
+    if (rule->rateLimit == RATE_LIMIT_NONE)
+        return runRule(bufId, path, rule);
+
+    if (!*(link = findEntry(rule)))
+    {
+        if (!(*link = createEntry(rule)))
+        {
+            /* TODO error */
+            return 1;
+        }
+
+        /* A throttled rule is executed right away, only the executions
+        ** within the window it opens are deferred.
+        */
+
+        if (rule->rateLimit == RATE_LIMIT_THROTTLE)
+            return runRule(bufId, path, rule);
+    }
+    else if (rule->rateLimit == RATE_LIMIT_DEBOUNCE)
+    {
+        /* Setting the timer again under its ID restarts the window. Windows
+        ** might return a new ID for a thread timer, timerProc() looks the
+        ** entry up by it. If it fails, the running window stays in effect.
+        */
+
+        if (!(timerId = SetTimer(NULL, (*link)->timerId, rule->rateWindow,
+                                 timerProc)))
+        {
+            /* TODO error */
+        }
+        else
+        {
+            (*link)->timerId = timerId;
+        }
+    }
+
+    return deferExec(*link, bufId, path);
+}
+
+void cancelDeferredExecs(void)
+{
+    while (entries)
+        removeEntry(&entries);
+}
+
+void getRateLimitStats(unsigned long long *deferred,
+                       unsigned long long *superseded)
+{
+    *deferred = deferredCnt;
+    *superseded = supersededCnt;
+}
+
+int runRule(uptr_t bufId, const wchar_t *path, Rule *rule)
+{
+    if (execRule(bufId, path, rule))
+    {
+        /* TODO error */
+        return 1;
+    }
+
+    rule->stats.execCnt++;
+
+    return 0;
+}
+
+int deferExec(Entry *entry, uptr_t bufId, const wchar_t *path)
+{
+    wchar_t *copy;
+
+    if (!(copy = copyStr(path)))
+    {
+        /* TODO error */
+        return 1;
+    }
+
+    if (entry->path)
+    {
+        freeStr(entry->path);
+        supersededCnt++;
+    }
+
+    entry->bufId = bufId;
+    entry->path = copy;
+    deferredCnt++;
+
+    return 0;
+}
+
+void CALLBACK timerProc(HWND wnd, UINT msg, UINT_PTR timerId, DWORD sysTime)
+{
+    Entry **link;
+    Rule *rule;
+    uptr_t bufId;
+    wchar_t *path;
+
+    link = &entries;
+
+    while (*link && (*link)->timerId != timerId)
+        link = &(*link)->next;
+
+    if (!*link)
+        return;
+
+    /* The window of a throttled rule ends once a period passed without any
+    ** deferred execution.
+    */
+
+    if (!(path = (*link)->path))
+    {
+        removeEntry(link);
+        return;
+    }
+
+    rule = (*link)->rule;
+    bufId = (*link)->bufId;
+    (*link)->path = NULL;
+
+    /* A debounced rule is done, a throttled one starts another window. The
+    ** entry isn't touched after the execution, since a foreground rule opens
+    ** a modal dialog which dispatches notifications and timers.
+    */
+
+    if (rule->rateLimit == RATE_LIMIT_DEBOUNCE)
+        removeEntry(link);
+
+    if (runRule(bufId, path, rule))
+    {
+        /* TODO error */
+    }
+
+    freeStr(path);
+}
+
+Entry** findEntry(const Rule *rule)
+{
+    Entry **link;
+
+    link = &entries;
+
+    while (*link && (*link)->rule != rule)
+        link = &(*link)->next;
+
+    return link;
+}
+
+Entry* createEntry(Rule *rule)
+{
+    Entry *entry;
+
+    if (!(entry = allocMem(sizeof *entry)))
+    {
+        /* TODO error */
+        goto fail_alloc;
+    }
+
+    /* Windows of 0 ms are raised to USER_TIMER_MINIMUM by the system. */
+
+    if (!(entry->timerId = SetTimer(NULL, 0, rule->rateWindow, timerProc)))
+    {
+        /* TODO error */
+        goto fail_timer;
+    }
+
+    entry->rule = rule;
+    entry->path = NULL;
+    entry->next = NULL;
+
+    return entry;
+
+fail_timer:
+    freeMem(entry);
+fail_alloc:
+    return NULL;
+}
+
+void removeEntry(Entry **link)
+{
+    Entry *entry;
+
+    entry = *link;
+    *link = entry->next;
+
+    KillTimer(NULL, entry->timerId);
+    freeStr(entry->path);
+    freeMem(entry);
+}
@@ -0,0 +1,53 @@
+/*
+This file is part of NppEventExec
+Copyright (C) 2016-2017 Mihail Ivanchev
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef __RATE_LIMIT_H__
+#define __RATE_LIMIT_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Executes a rule which matched a notification unless its rate limit defers
+ * the execution. A deferred execution is started by a timer once the rate
+ * window allows it, for the buffer and path of the last notification.
+ * \param bufId the ID of the buffer the notification was sent for.
+ * \param path the path of the buffer, it's copied if the execution is deferred.
+ * \param rule the rule, whose execution count is updated once it's executed.
+ * \return 0 if the rule was executed or deferred, non-zero upon an error.
+ */
+int execLimitedRule(uptr_t bufId, const wchar_t *path, Rule *rule);
+
+/**
+ * Drops the deferred executions and stops the timers. Has to be called before
+ * the rules are replaced or freed.
+ */
+void cancelDeferredExecs(void);
+
+/**
+ * Returns how many executions were deferred by the rate limits and how many
+ * of those were superseded by a later one of the same rule.
+ */
+void getRateLimitStats(unsigned long long *deferred,
+                       unsigned long long *superseded);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __RATE_LIMIT_H__ */
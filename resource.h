@@ -54,6 +54,7 @@ along with this program. If not, see <http://www.gnu.org/licenses/>.
 #define IDC_LV_RULES 3000
 #define IDC_BT_SAVE  3001
 #define IDC_BT_RESET 3002
+#define IDC_BT_RESET_STATS 3003
 
 #define IDC_ST_NAME          4000
 #define IDC_ED_NAME          4001
@@ -69,6 +70,24 @@ along with this program. If not, see <http://www.gnu.org/licenses/>.
 #define IDC_BT_ENABLED       4011
 #define IDC_BT_FOREGROUND    4012
 #define IDC_BT_APPLY         4013
+#define IDC_ST_GLOB          4014
+#define IDC_ED_GLOB          4015
+#define IDC_ST_GLOB_ERROR    4016
+#define IDC_BT_STOP          4017
+#define IDC_ST_SCOPE         4018
+#define IDC_ED_SCOPE         4019
+#define IDC_ST_SCOPE_ERROR   4020
+#define IDC_ST_TARGET        4021
+#define IDC_CB_TARGET        4022
+#define IDC_BT_CANONICAL     4023
+#define IDC_ST_COALESCE      4024
+#define IDC_CB_COALESCE      4025
+#define IDC_ST_RATE_LIMIT    4026
+#define IDC_CB_RATE_LIMIT    4027
+#define IDC_ST_RATE_WINDOW   4028
+#define IDC_ED_RATE_WINDOW   4029
+#define IDC_ST_PRIORITY      4030
+#define IDC_CB_PRIORITY      4031
 
 /* TODO: Check again why the IDs begin at 0x8000 and replace this comment with
 ** the info.
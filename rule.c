@@ -18,6 +18,8 @@ along with NppEventExec. If not, see <http://www.gnu.org/licenses/>.
 #include "base.h"
 #include "event_map.h"
 #include "csv.h"
+#include "glob.h"
+#include "scope.h"
 #include "match.h"
 #include "mem.h"
 #include "plugin.h"
@@ -28,13 +30,28 @@ along with NppEventExec. If not, see <http://www.gnu.org/licenses/>.
 /** TODO doc */
 #define FILENAME PLUGIN_NAME L"_rules.csv"
 
+/** The maximum number of threads compiling the regexes of the rules. */
+#define MAX_COMPILE_THREADS 4
+
 typedef struct
 {
     wchar_t *header;
     int (*reader)(Rule*);
     int (*writer)(Rule*);
+    int (*def)(Rule*);
 } CsvField;
 
+/* The rules whose regexes are compiled by the threads. Every thread takes the
+** next rule until none are left.
+*/
+
+typedef struct
+{
+    Rule **rules;
+    LONG cnt;
+    volatile LONG next;
+} CompileJob;
+
 static int readEvent(Rule *rule);
 static int writeEvent(Rule *rule);
 static int readEnabled(Rule *rule);
@@ -47,14 +64,90 @@ static int readCmd(Rule *rule);
 static int writeCmd(Rule *rule);
 static int readBackground(Rule *rule);
 static int writeBackground(Rule *rule);
+static int readGlob(Rule *rule);
+static int writeGlob(Rule *rule);
+static int defGlob(Rule *rule);
+static int readStop(Rule *rule);
+static int writeStop(Rule *rule);
+static int defStop(Rule *rule);
+static int readScope(Rule *rule);
+static int writeScope(Rule *rule);
+static int defScope(Rule *rule);
+static int readTarget(Rule *rule);
+static int writeTarget(Rule *rule);
+static int defTarget(Rule *rule);
+static int readCanonical(Rule *rule);
+static int writeCanonical(Rule *rule);
+static int defCanonical(Rule *rule);
+static int readCoalesce(Rule *rule);
+static int writeCoalesce(Rule *rule);
+static int defCoalesce(Rule *rule);
+static int readRateLimit(Rule *rule);
+static int writeRateLimit(Rule *rule);
+static int defRateLimit(Rule *rule);
+static int readRateWindow(Rule *rule);
+static int writeRateWindow(Rule *rule);
+static int defRateWindow(Rule *rule);
+static int readPriority(Rule *rule);
+static int writePriority(Rule *rule);
+static int defPriority(Rule *rule);
+static int compileRegexes(Rule *rules, int ruleCnt);
+static DWORD WINAPI compileProc(LPVOID param);
+
+/* Fields with a default initializer may be missing from files written by
+** older versions; they have to come after all fields without one.
+*/
 
 static CsvField fields[] = {
-    { L"Event", readEvent, writeEvent },
-    { L"Enabled?", readEnabled, writeEnabled},
-    { L"Name", readName, writeName },
-    { L"Regex", readRegex, writeRegex },
-    { L"Command", readCmd, writeCmd },
-    { L"Background?", readBackground, writeBackground }
+    { L"Event", readEvent, writeEvent, NULL },
+    { L"Enabled?", readEnabled, writeEnabled, NULL },
+    { L"Name", readName, writeName, NULL },
+    { L"Regex", readRegex, writeRegex, NULL },
+    { L"Command", readCmd, writeCmd, NULL },
+    { L"Background?", readBackground, writeBackground, NULL },
+    { L"Glob", readGlob, writeGlob, defGlob },
+    { L"Stop?", readStop, writeStop, defStop },
+    { L"Scope", readScope, writeScope, defScope },
+    { L"Target", readTarget, writeTarget, defTarget },
+    { L"Canonical?", readCanonical, writeCanonical, defCanonical },
+    { L"Coalesce", readCoalesce, writeCoalesce, defCoalesce },
+    { L"Rate limit", readRateLimit, writeRateLimit, defRateLimit },
+    { L"Window (ms)", readRateWindow, writeRateWindow, defRateWindow },
+    { L"Priority", readPriority, writePriority, defPriority }
+};
+
+/* The names of the match targets in the order of MatchTarget. */
+
+static const wchar_t *targetNames[] = {
+    L"Path",
+    L"Directory",
+    L"Filename",
+    L"Extension"
+};
+
+/* The names of the coalescing policies in the order of CoalescePolicy. */
+
+static const wchar_t *coalesceNames[] = {
+    L"Never",
+    L"Keep first",
+    L"Keep latest"
+};
+
+/* The names of the rate limits in the order of RateLimit. */
+
+static const wchar_t *rateLimitNames[] = {
+    L"None",
+    L"Debounce",
+    L"Throttle"
+};
+
+/* The names of the priorities in the order of Priority. */
+
+static const wchar_t *priorityNames[] = {
+    L"Default",
+    L"Low",
+    L"Normal",
+    L"High"
 };
 
 int readRules(Rule **rules)
@@ -65,6 +158,8 @@ int readRules(Rule **rules)
     Rule *last;
     Rule *rule;
     int ruleCnt;
+    size_t minFieldCnt;
+    size_t fieldCnt;
     size_t ii;
 
     assert(rules);
@@ -87,7 +182,10 @@ int readRules(Rule **rules)
         goto fail_attribs;
     }
 
-    if (csvOpen(path, BUFLEN(fields), 1))
+    for (minFieldCnt = 0; !fields[minFieldCnt].def; minFieldCnt++)
+        ;
+
+    if (csvOpenVariable(path, minFieldCnt, BUFLEN(fields), &fieldCnt))
     {
         /* TODO error */
         goto fail_open;
@@ -115,12 +213,22 @@ int readRules(Rule **rules)
         rule->name = NULL;
         rule->regex = NULL;
         rule->cmd = NULL;
+        rule->glob = NULL;
+        rule->scope = NULL;
+        rule->matcher = NULL;
+        rule->globMatcher = NULL;
+        ZeroMemory(&rule->stats, sizeof rule->stats);
 
-        for (ii = 0; ii < BUFLEN(fields); ii++)
+        for (ii = 0; ii < fieldCnt; ii++)
         {
             if (fields[ii].reader(rule))
                 goto fail_read;
         }
+        for (; ii < BUFLEN(fields); ii++)
+        {
+            if (fields[ii].def(rule))
+                goto fail_read;
+        }
 
         rule->next = NULL;
 
@@ -139,14 +247,32 @@ int readRules(Rule **rules)
     }
 
     csvClose();
+
+    /* The regexes are only compiled once all records were parsed. */
+
+    if (compileRegexes(list, ruleCnt))
+    {
+        /* TODO error */
+        goto fail_compile;
+    }
+
     freeStr(path);
     *rules = list;
     return 0;
 
+fail_compile:
+    freeRules(list);
+    freeStr(path);
+    return 1;
+
 fail_read:
     freeStr(rule->name);
     freeStr(rule->regex);
     freeStr(rule->cmd);
+    freeStr(rule->glob);
+    freeStr(rule->scope);
+    freeMatcher(rule->matcher);
+    freeGlob(rule->globMatcher);
     freeMem(rule);
 fail_rule:
 fail_too_many_rules:
@@ -252,6 +378,10 @@ void freeRule(Rule *rule)
     freeStr(rule->name);
     freeStr(rule->regex);
     freeStr(rule->cmd);
+    freeStr(rule->glob);
+    freeStr(rule->scope);
+    freeMatcher(rule->matcher);
+    freeGlob(rule->globMatcher);
     freeMem(rule);
 }
 
@@ -277,6 +407,8 @@ Rule* copyRule(const Rule *rule)
     assert(rule->name);
     assert(rule->regex);
     assert(rule->cmd);
+    assert(rule->glob);
+    assert(rule->scope);
 
     if (!(copy = allocMem(sizeof(Rule))))
     {
@@ -298,14 +430,67 @@ Rule* copyRule(const Rule *rule)
         /* TODO error */
         goto fail_cmd;
     }
+    if (!(copy->glob = copyStr(rule->glob)))
+    {
+        /* TODO error */
+        goto fail_glob;
+    }
+    if (!(copy->scope = copyStr(rule->scope)))
+    {
+        /* TODO error */
+        goto fail_scope;
+    }
+
+    /* Rules which were never compiled, e.g. the template for new rules, get
+    ** their matcher here.
+    */
+
+    if (rule->matcher)
+        copy->matcher = copyMatcher(rule->matcher);
+    else
+        copy->matcher = compileMatcher(rule->regex);
+
+    if (!copy->matcher)
+    {
+        /* TODO error */
+        goto fail_matcher;
+    }
+
+    /* Glob lists are cheap to compile, so they aren't shared. */
+
+    if (!*copy->glob)
+    {
+        copy->globMatcher = NULL;
+    }
+    else if (!(copy->globMatcher = compileGlob(copy->glob)))
+    {
+        /* TODO error */
+        goto fail_glob_matcher;
+    }
 
     copy->event = rule->event;
     copy->enabled = rule->enabled;
     copy->background = rule->background;
+    copy->stop = rule->stop;
+    copy->target = rule->target;
+    copy->canonical = rule->canonical;
+    copy->coalesce = rule->coalesce;
+    copy->rateLimit = rule->rateLimit;
+    copy->rateWindow = rule->rateWindow;
+    copy->priority = rule->priority;
+    copy->stats = rule->stats;
     copy->next = NULL;
 
     return copy;
 
+fail_glob_matcher:
+    freeMatcher(copy->matcher);
+fail_matcher:
+    freeStr(copy->scope);
+fail_scope:
+    freeStr(copy->glob);
+fail_glob:
+    freeStr(copy->cmd);
 fail_cmd:
     freeStr(copy->regex);
 fail_regex:
@@ -383,6 +568,44 @@ int getRuleCount(const Rule *rules)
     return cnt;
 }
 
+void resetRuleStats(Rule *rules)
+{
+    for (; rules; rules = rules->next)
+        ZeroMemory(&rules->stats, sizeof rules->stats);
+}
+
+const wchar_t* getMatchTargetName(MatchTarget target)
+{
+    assert(target < BUFLEN(targetNames));
+    return targetNames[target];
+}
+
+const wchar_t* getCoalescePolicyName(CoalescePolicy policy)
+{
+    assert(policy < BUFLEN(coalesceNames));
+    return coalesceNames[policy];
+}
+
+const wchar_t* getRateLimitName(RateLimit limit)
+{
+    assert(limit < BUFLEN(rateLimitNames));
+    return rateLimitNames[limit];
+}
+
+const wchar_t* getPriorityName(Priority priority)
+{
+    assert(priority < BUFLEN(priorityNames));
+    return priorityNames[priority];
+}
+
+Priority getEffectivePriority(const Rule *rule)
+{
+    if (rule->priority != PRIORITY_DEFAULT)
+        return rule->priority;
+
+    return rule->background ? PRIORITY_NORMAL : PRIORITY_HIGH;
+}
+
 int readEvent(Rule *rule)
 {
     return csvReadEvent(&rule->event);
@@ -458,19 +681,121 @@ int readRegex(Rule *rule)
     size_t unitCnt;
     size_t charCnt;
 
+    /* The regex is compiled by compileRegexes. */
+
     if (!(res = csvReadString(&unitCnt, &charCnt)))
     {
         /* TODO error */
         return 1;
     }
-    if (!isValidRegex(res))
+
+    rule->regex = res;
+    return 0;
+}
+
+int compileRegexes(Rule *rules, int ruleCnt)
+{
+    HANDLE threads[MAX_COMPILE_THREADS - 1];
+    SYSTEM_INFO info;
+    CompileJob job;
+    Rule *rule;
+    DWORD threadCnt;
+    DWORD ii;
+    int failed;
+    int jj;
+
+    if (!ruleCnt)
+        return 0;
+
+    if (!(job.rules = allocMem(ruleCnt * sizeof *job.rules)))
     {
         /* TODO error */
-        freeStr(res);
         return 1;
     }
 
-    rule->regex = res;
+    for (rule = rules, jj = 0; rule; rule = rule->next, jj++)
+        job.rules[jj] = rule;
+
+    job.cnt = ruleCnt;
+    job.next = 0;
+
+    /* The calling thread compiles regexes as well, so a thread which can't
+    ** be created only slows the compilation down.
+    */
+
+    GetSystemInfo(&info);
+    threadCnt = MIN(info.dwNumberOfProcessors, MAX_COMPILE_THREADS);
+    threadCnt = MIN(threadCnt, (DWORD) ruleCnt);
+
+    for (ii = 0; ii + 1 < threadCnt; ii++)
+    {
+        if (!(threads[ii] = CreateThread(NULL, 0, compileProc, &job, 0, NULL)))
+        {
+            /* TODO error */
+            break;
+        }
+    }
+
+    threadCnt = ii;
+    compileProc(&job);
+
+    if (threadCnt)
+    {
+        WaitForMultipleObjects(threadCnt, threads, TRUE, INFINITE);
+
+        for (ii = 0; ii < threadCnt; ii++)
+            CloseHandle(threads[ii]);
+    }
+
+    /* The header is record 1, so the rule at position jj is in record
+    ** jj + 2.
+    */
+
+    failed = 0;
+
+    for (jj = 0; jj < ruleCnt; jj++)
+    {
+        rule = job.rules[jj];
+
+        if (!rule->matcher)
+        {
+            /* TODO error */
+            errorMsgBox(NULL,
+                        L"The regular expression of the rule \"%ls\" in "
+                        L"record %d of the rules file is invalid.",
+                        rule->name, jj + 2);
+            failed = 1;
+        }
+        else if (isExponentialRegex(rule->matcher, rule->regex))
+        {
+            /* The rule is loaded anyway, it's disabled once matching it
+            ** takes too long.
+            */
+
+            msgBox(MB_OK | MB_ICONWARNING, getNppWnd(),
+                   PLUGIN_NAME L": Slow regular expression",
+                   L"The regular expression of the rule \"%ls\" in record %d "
+                   L"of the rules file repeats a group which contains a "
+                   L"repetition itself. Matching it may take exponential "
+                   L"time, in which case the rule is disabled.",
+                   rule->name, jj + 2);
+        }
+    }
+
+    freeMem(job.rules);
+    return failed;
+}
+
+DWORD WINAPI compileProc(LPVOID param)
+{
+    CompileJob *job;
+    LONG ii;
+
+    job = param;
+
+    while ((ii = InterlockedIncrement(&job->next) - 1) < job->cnt)
+        job->rules[ii]->matcher = compileMatcher(job->rules[ii]->regex);
+
     return 0;
 }
 
@@ -532,6 +857,354 @@ int writeBackground(Rule *rule)
     return csvWriteBool(rule->background, BOOL_YES_NO);
 }
 
+int readGlob(Rule *rule)
+{
+    wchar_t *res;
+    size_t unitCnt;
+    size_t charCnt;
+
+    if (!(res = csvReadString(&unitCnt, &charCnt)))
+    {
+        /* TODO error */
+        return 1;
+    }
+    if (charCnt && !(rule->globMatcher = compileGlob(res)))
+    {
+        /* TODO error */
+        freeStr(res);
+        return 1;
+    }
+
+    rule->glob = res;
+    return 0;
+}
+
+int writeGlob(Rule *rule)
+{
+    return csvWriteString(rule->glob);
+}
+
+int defGlob(Rule *rule)
+{
+    if (!(rule->glob = copyStr(L"")))
+    {
+        /* TODO error */
+        return 1;
+    }
+
+    return 0;
+}
+
+int readStop(Rule *rule)
+{
+    int res;
+
+    if ((res = csvReadBool()) < 0)
+    {
+        /* TODO error */
+        return 1;
+    }
+
+    rule->stop = res;
+
+    return 0;
+}
+
+int writeStop(Rule *rule)
+{
+    return csvWriteBool(rule->stop, BOOL_YES_NO);
+}
+
+int defStop(Rule *rule)
+{
+    rule->stop = 0;
+    return 0;
+}
+
+int readScope(Rule *rule)
+{
+    wchar_t *res;
+    size_t unitCnt;
+    size_t charCnt;
+
+    if (!(res = csvReadString(&unitCnt, &charCnt)))
+    {
+        /* TODO error */
+        return 1;
+    }
+    if (!isValidScope(res))
+    {
+        /* TODO error */
+        freeStr(res);
+        return 1;
+    }
+
+    rule->scope = res;
+    return 0;
+}
+
+int writeScope(Rule *rule)
+{
+    return csvWriteString(rule->scope);
+}
+
+int defScope(Rule *rule)
+{
+    if (!(rule->scope = copyStr(L"")))
+    {
+        /* TODO error */
+        return 1;
+    }
+
+    return 0;
+}
+
+int readTarget(Rule *rule)
+{
+    wchar_t *res;
+    size_t unitCnt;
+    size_t charCnt;
+    size_t ii;
+
+    if (!(res = csvReadString(&unitCnt, &charCnt)))
+    {
+        /* TODO error */
+        return 1;
+    }
+
+    for (ii = 0; ii < BUFLEN(targetNames); ii++)
+    {
+        if (!lstrcmpiW(res, targetNames[ii]))
+            break;
+    }
+
+    freeStr(res);
+
+    if (ii == BUFLEN(targetNames))
+    {
+        /* TODO error */
+        return 1;
+    }
+
+    rule->target = (MatchTarget) ii;
+    return 0;
+}
+
+int writeTarget(Rule *rule)
+{
+    return csvWriteString(getMatchTargetName(rule->target));
+}
+
+int defTarget(Rule *rule)
+{
+    rule->target = MATCH_TARGET_PATH;
+    return 0;
+}
+
+int readCanonical(Rule *rule)
+{
+    int res;
+
+    if ((res = csvReadBool()) < 0)
+    {
+        /* TODO error */
+        return 1;
+    }
+
+    rule->canonical = res;
+
+    return 0;
+}
+
+int writeCanonical(Rule *rule)
+{
+    return csvWriteBool(rule->canonical, BOOL_YES_NO);
+}
+
+int defCanonical(Rule *rule)
+{
+    rule->canonical = 0;
+    return 0;
+}
+
+int readCoalesce(Rule *rule)
+{
+    wchar_t *res;
+    size_t unitCnt;
+    size_t charCnt;
+    size_t ii;
+
+    if (!(res = csvReadString(&unitCnt, &charCnt)))
+    {
+        /* TODO error */
+        return 1;
+    }
+
+    for (ii = 0; ii < BUFLEN(coalesceNames); ii++)
+    {
+        if (!lstrcmpiW(res, coalesceNames[ii]))
+            break;
+    }
+
+    freeStr(res);
+
+    if (ii == BUFLEN(coalesceNames))
+    {
+        /* TODO error */
+        return 1;
+    }
+
+    rule->coalesce = (CoalescePolicy) ii;
+    return 0;
+}
+
+int writeCoalesce(Rule *rule)
+{
+    return csvWriteString(getCoalescePolicyName(rule->coalesce));
+}
+
+int defCoalesce(Rule *rule)
+{
+    rule->coalesce = COALESCE_NEVER;
+    return 0;
+}
+
+int readRateLimit(Rule *rule)
+{
+    wchar_t *res;
+    size_t unitCnt;
+    size_t charCnt;
+    size_t ii;
+
+    if (!(res = csvReadString(&unitCnt, &charCnt)))
+    {
+        /* TODO error */
+        return 1;
+    }
+
+    for (ii = 0; ii < BUFLEN(rateLimitNames); ii++)
+    {
+        if (!lstrcmpiW(res, rateLimitNames[ii]))
+            break;
+    }
+
+    freeStr(res);
+
+    if (ii == BUFLEN(rateLimitNames))
+    {
+        /* TODO error */
+        return 1;
+    }
+
+    rule->rateLimit = (RateLimit) ii;
+    return 0;
+}
+
+int writeRateLimit(Rule *rule)
+{
+    return csvWriteString(getRateLimitName(rule->rateLimit));
+}
+
+int defRateLimit(Rule *rule)
+{
+    rule->rateLimit = RATE_LIMIT_NONE;
+    return 0;
+}
+
+int readRateWindow(Rule *rule)
+{
+    wchar_t *res;
+    wchar_t *chr;
+    unsigned int window;
+    size_t unitCnt;
+    size_t charCnt;
+
+    if (!(res = csvReadString(&unitCnt, &charCnt)))
+    {
+        /* TODO error */
+        return 1;
+    }
+
+    window = 0;
+
+    for (chr = res; *chr >= L'0' && *chr <= L'9'; chr++)
+    {
+        window = 10 * window + (*chr - L'0');
+
+        if (window > MAX_RATE_WINDOW_IN_MS)
+            break;
+    }
+
+    if (!*res || *chr)
+    {
+        /* TODO error */
+        freeStr(res);
+        return 1;
+    }
+
+    freeStr(res);
+
+    rule->rateWindow = window;
+    return 0;
+}
+
+int writeRateWindow(Rule *rule)
+{
+    wchar_t buf[16];
+
+    StringCchPrintfW(buf, BUFLEN(buf), L"%u", rule->rateWindow);
+
+    return csvWriteString(buf);
+}
+
+int defRateWindow(Rule *rule)
+{
+    rule->rateWindow = 0;
+    return 0;
+}
+
+int readPriority(Rule *rule)
+{
+    wchar_t *res;
+    size_t unitCnt;
+    size_t charCnt;
+    size_t ii;
+
+    if (!(res = csvReadString(&unitCnt, &charCnt)))
+    {
+        /* TODO error */
+        return 1;
+    }
+
+    for (ii = 0; ii < BUFLEN(priorityNames); ii++)
+    {
+        if (!lstrcmpiW(res, priorityNames[ii]))
+            break;
+    }
+
+    freeStr(res);
+
+    if (ii == BUFLEN(priorityNames))
+    {
+        /* TODO error */
+        return 1;
+    }
+
+    rule->priority = (Priority) ii;
+    return 0;
+}
+
+int writePriority(Rule *rule)
+{
+    return csvWriteString(getPriorityName(rule->priority));
+}
+
+int defPriority(Rule *rule)
+{
+    rule->priority = PRIORITY_DEFAULT;
+    return 0;
+}
+
 #ifdef DEBUG
 void printRules(Rule *rules)
 {
@@ -547,8 +1220,17 @@ void printRules(Rule *rules)
         wprintf(L"Enabled:    %ls\r\n", rr->enabled ? L"true" : L"false");
         wprintf(L"Name:       %ls\r\n", rr->name);
         wprintf(L"Regex:      %ls\r\n", rr->regex);
+        wprintf(L"Glob:       %ls\r\n", rr->glob);
+        wprintf(L"Scope:      %ls\r\n", rr->scope);
+        wprintf(L"Target:     %ls\r\n", getMatchTargetName(rr->target));
+        wprintf(L"Canonical:  %ls\r\n", rr->canonical ? L"true" : L"false");
+        wprintf(L"Coalesce:   %ls\r\n", getCoalescePolicyName(rr->coalesce));
+        wprintf(L"Rate limit: %ls, %u ms\r\n", getRateLimitName(rr->rateLimit),
+                rr->rateWindow);
+        wprintf(L"Priority:   %ls\r\n", getPriorityName(rr->priority));
         wprintf(L"Command:    %ls\r\n", rr->cmd);
         wprintf(L"Background: %ls\r\n", rr->background ? L"true" : L"false");
+        wprintf(L"Stop:       %ls\r\n", rr->stop ? L"true" : L"false");
 
         if (rr->next)
             wprintf(L"\r\n");
@@ -18,14 +18,102 @@ along with this program. If not, see <http://www.gnu.org/licenses/>.
 #ifndef __RULE_H__
 #define __RULE_H__
 
+/* Counted while the rules are dispatched, the times are in nanoseconds. A
+** rule is evaluated whenever its regex or glob list is checked against a path
+** and matches whenever such an evaluation succeeds. Matches remembered from an
+** earlier evaluation aren't counted, so a rule never has more matches than
+** evaluations.
+*/
+
+typedef struct
+{
+    unsigned long long evalCnt;
+    unsigned long long matchCnt;
+    unsigned long long totalNanos;
+    unsigned long long maxNanos;
+    unsigned long long execCnt;
+} RuleStats;
+
+/* The part of the path of a document which the regex of a rule is matched
+** against. The directory is the path without the separator and the filename
+** at the end, the extension is the part of the filename after its last dot
+** and is empty if it has none.
+*/
+
+typedef enum
+{
+    MATCH_TARGET_PATH,
+    MATCH_TARGET_DIR,
+    MATCH_TARGET_FILENAME,
+    MATCH_TARGET_EXT,
+    MATCH_TARGET_CNT
+} MatchTarget;
+
+/* What happens if a rule is executed for a document while an execution of
+** the rule for the same document is still waiting in the queue: the new
+** execution is queued as well, dropped, or replaces the queued one, which
+** keeps its position.
+*/
+
+typedef enum
+{
+    COALESCE_NEVER,
+    COALESCE_KEEP_FIRST,
+    COALESCE_KEEP_LATEST,
+    COALESCE_CNT
+} CoalescePolicy;
+
+/* How a rule is executed when the notifications it matches come in bursts:
+** a debounced rule once none matched it for its rate window, a throttled rule
+** at most once per window. Either way the deferred execution is for the
+** buffer of the last notification.
+*/
+
+typedef enum
+{
+    RATE_LIMIT_NONE,
+    RATE_LIMIT_DEBOUNCE,
+    RATE_LIMIT_THROTTLE,
+    RATE_LIMIT_CNT
+} RateLimit;
+
+/** The longest rate window of a rule, an hour. */
+#define MAX_RATE_WINDOW_IN_MS 3600000
+
+/* The priority class of the executions of a rule in the queue. By default
+** foreground rules are in the high class and background rules in the normal
+** class, since a foreground rule blocks the user until it's done.
+*/
+
+typedef enum
+{
+    PRIORITY_DEFAULT,
+    PRIORITY_LOW,
+    PRIORITY_NORMAL,
+    PRIORITY_HIGH,
+    PRIORITY_CNT
+} Priority;
+
 typedef struct _Rule
 {
     int enabled;
     int background;
+    int stop;
+    int canonical;
     unsigned int event;
+    MatchTarget target;
+    CoalescePolicy coalesce;
+    RateLimit rateLimit;
+    unsigned int rateWindow;
+    Priority priority;
     wchar_t *name;
     wchar_t *regex;
     wchar_t *cmd;
+    wchar_t *glob;
+    wchar_t *scope;
+    struct _Matcher *matcher;
+    struct _GlobMatcher *globMatcher;
+    RuleStats stats;
     struct _Rule *next;
 } Rule;
 
@@ -41,6 +129,12 @@ Rule* copyRule(const Rule *rule);
 int copyRules(const Rule *rules, Rule **first, Rule **last);
 Rule* getRuleAt(Rule *rule, int pos);
 int getRuleCount(const Rule *rules);
+void resetRuleStats(Rule *rules);
+const wchar_t* getMatchTargetName(MatchTarget target);
+const wchar_t* getCoalescePolicyName(CoalescePolicy policy);
+const wchar_t* getRateLimitName(RateLimit limit);
+const wchar_t* getPriorityName(Priority priority);
+Priority getEffectivePriority(const Rule *rule);
 
 #ifdef DEBUG
 void printRules(Rule *rules);
@@ -0,0 +1,620 @@
+/*
+This file is part of NppEventExec
+Copyright (C) 2016-2017 Mihail Ivanchev
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "base.h"
+#include "event_map.h"
+#include "glob.h"
+#include "match.h"
+#include "mem.h"
+#include "rule.h"
+#include "rule_table.h"
+#include "scope.h"
+#include "Notepad_plus_msgs.h"
+
+/** The number of evaluations of a bucket after which it's reordered. */
+#define REORDER_INTERVAL 256
+
+/** The assumed time of a glob list which was never evaluated. */
+#define DEFAULT_GLOB_NANOS 200.0
+
+/** The assumed time of a regex which was never evaluated on its own. */
+#define DEFAULT_REGEX_NANOS 2000.0
+
+/* The marks of the entries in RuleTable::matched. */
+
+#define ENTRY_MATCHED  0x01
+#define ENTRY_IN_SCOPE 0x02
+
+static unsigned long lastGen;
+
+/* The bucket being ordered by compareOrder. */
+
+static const RuleTable *sortTable;
+static const RuleBucket *sortBucket;
+
+static int compileBuckets(RuleTable *table);
+static void orderBucket(RuleTable *table, RuleBucket *bucket);
+static int compareOrder(const void *index1, const void *index2);
+static double getEntryScore(const RuleTable *table, size_t index);
+
+RuleTable* buildRuleTable(Rule *rules)
+{
+    RuleTable *table;
+    RuleEntry *entry;
+    Rule *rule;
+    size_t index;
+    size_t cnt;
+    size_t size;
+    size_t ii;
+    size_t jj;
+
+    cnt = 0;
+
+    for (rule = rules; rule; rule = rule->next)
+        cnt += rule->enabled;
+
+    /* The table, the buckets, the entries, the rule pointers, the evaluation
+    ** order and the scratch space are stored in a single allocation in this
+    ** order.
+    */
+
+    if (cnt > (SIZE_MAX - sizeof *table - eventMapSize * sizeof(RuleBucket))
+        / (sizeof(RuleEntry) + sizeof(Rule*) + sizeof(size_t) + 1))
+    {
+        /* TODO error */
+        return NULL;
+    }
+
+    size = sizeof *table
+           + eventMapSize * sizeof(RuleBucket)
+           + cnt * (sizeof(RuleEntry) + sizeof(Rule*) + sizeof(size_t) + 1);
+
+    if (!(table = allocMem(size)))
+    {
+        /* TODO error */
+        return NULL;
+    }
+
+    table->buckets = (RuleBucket*) (table + 1);
+    table->entries = (RuleEntry*) (table->buckets + eventMapSize);
+    table->rules = (Rule**) (table->entries + cnt);
+    table->order = (size_t*) (table->rules + cnt);
+    table->matched = (unsigned char*) (table->order + cnt);
+    table->cnt = cnt;
+    table->events = 0;
+    table->gen = ++lastGen;
+
+    for (ii = 0; ii < eventMapSize; ii++)
+    {
+        table->buckets[ii].first = 0;
+        table->buckets[ii].cnt = 0;
+        table->buckets[ii].globCnt = 0;
+        table->buckets[ii].expensiveCnt = 0;
+        table->buckets[ii].evalCnt = 0;
+        table->buckets[ii].inputs = 0;
+        table->buckets[ii].scopes = NULL;
+
+        for (jj = 0; jj < MATCH_INPUT_CNT; jj++)
+            table->buckets[ii].matchers[jj] = NULL;
+    }
+
+    /* Count the rules of every event first, then assign each bucket its range
+    ** and finally fill in the entries. The second pass resets the counts so
+    ** they can be used as insertion positions.
+    */
+
+    for (rule = rules; rule; rule = rule->next)
+    {
+        if (rule->enabled && getEventMapEntryIndex(rule->event, &index))
+            table->buckets[index].cnt++;
+    }
+
+    for (ii = 1; ii < eventMapSize; ii++)
+    {
+        table->buckets[ii].first = table->buckets[ii - 1].first
+                                   + table->buckets[ii - 1].cnt;
+    }
+
+    for (ii = 0; ii < eventMapSize; ii++)
+        table->buckets[ii].cnt = 0;
+
+    for (rule = rules; rule; rule = rule->next)
+    {
+        if (!rule->enabled || !getEventMapEntryIndex(rule->event, &index))
+            continue;
+
+        ii = table->buckets[index].first + table->buckets[index].cnt++;
+        entry = &table->entries[ii];
+        entry->event = rule->event;
+        entry->flags = (rule->background ? RULE_FLAG_BACKGROUND : 0)
+                       | (rule->stop ? RULE_FLAG_STOP : 0)
+                       | (*rule->scope ? RULE_FLAG_SCOPED : 0);
+        entry->input = rule->target + (rule->canonical ? MATCH_TARGET_CNT : 0);
+        entry->matcher = rule->matcher;
+        entry->glob = rule->globMatcher;
+        table->rules[ii] = rule;
+
+        if (entry->glob)
+            table->buckets[index].globCnt++;
+
+        assert(rule->event - NPPN_FIRST < sizeof(table->events) * CHAR_BIT);
+        table->events |= 1UL << (rule->event - NPPN_FIRST);
+    }
+
+    if (compileBuckets(table))
+    {
+        /* TODO error */
+        freeRuleTable(table);
+        return NULL;
+    }
+
+    return table;
+}
+
+void freeRuleTable(RuleTable *table)
+{
+    size_t ii;
+    size_t jj;
+
+    if (!table)
+        return;
+
+    for (ii = 0; ii < eventMapSize; ii++)
+    {
+        for (jj = 0; jj < MATCH_INPUT_CNT; jj++)
+            freeRuleSetMatcher(table->buckets[ii].matchers[jj]);
+
+        freeScopeTrie(table->buckets[ii].scopes);
+    }
+
+    freeMem(table);
+}
+
+RuleBucket* getRuleBucket(RuleTable *table, unsigned int event)
+{
+    size_t index;
+
+    assert(table);
+
+    if (!getEventMapEntryIndex(event, &index))
+        return NULL;
+
+    return &table->buckets[index];
+}
+
+int isEventSubscribed(const RuleTable *table, unsigned int event)
+{
+    assert(table);
+
+    /* Codes below NPPN_FIRST wrap around and fail the range check. */
+
+    event -= NPPN_FIRST;
+
+    return event < sizeof(table->events) * CHAR_BIT
+           && (table->events >> event & 1);
+}
+
+size_t getAbortedEntryCount(const RuleBucket *bucket)
+{
+    size_t cnt;
+    int input;
+
+    assert(bucket);
+
+    cnt = 0;
+
+    for (input = 0; input < MATCH_INPUT_CNT; input++)
+    {
+        if (bucket->matchers[input])
+            cnt += getAbortedPatternCount(bucket->matchers[input]);
+    }
+
+    return cnt;
+}
+
+int isEntryAborted(const RuleTable *table,
+                   const RuleBucket *bucket,
+                   size_t index)
+{
+    const RuleSetMatcher *matcher;
+
+    assert(table);
+    assert(bucket);
+    assert(index < bucket->cnt);
+
+    /* Entries without a regex in the automaton have no matcher. */
+
+    matcher = bucket->matchers[table->entries[bucket->first + index].input];
+
+    return matcher && isPatternAborted(matcher, index);
+}
+
+size_t matchRuleBucket(RuleTable *table,
+                       RuleBucket *bucket,
+                       const wchar_t *const *inputs,
+                       size_t *matches,
+                       unsigned long long *nanos)
+{
+    const RuleEntry *entries;
+    const size_t *order;
+    const unsigned long long *inputNanos;
+    const wchar_t *path;
+    unsigned char *matched;
+    LARGE_INTEGER freq;
+    LARGE_INTEGER start;
+    LARGE_INTEGER end;
+    size_t scopeCnt;
+    size_t regexCnt;
+    size_t matchCnt;
+    size_t cutoff;
+    size_t ii;
+    size_t jj;
+    int input;
+    int res;
+
+    assert(table);
+    assert(bucket);
+    assert(inputs);
+    assert(inputs[MATCH_TARGET_PATH]);
+    assert(matches);
+    assert(nanos);
+
+    path = inputs[MATCH_TARGET_PATH];
+
+    entries = &table->entries[bucket->first];
+    order = &table->order[bucket->first];
+    matched = &table->matched[bucket->first];
+
+    memset(matched, 0, bucket->cnt);
+
+    /* A single walk of the directories of the path yields the scoped entries
+    ** which have to be evaluated, the others are skipped.
+    */
+
+    if (bucket->scopes)
+    {
+        scopeCnt = findScopes(bucket->scopes, path, matches);
+
+        for (ii = 0; ii < scopeCnt; ii++)
+            matched[matches[ii]] = ENTRY_IN_SCOPE;
+    }
+
+    /* The combined automaton of every input evaluates most regexes at once
+    ** and cheaply. The first stop rule they match cuts off all entries after
+    ** it.
+    */
+
+    memset(nanos, 0, bucket->cnt * sizeof *nanos);
+    cutoff = bucket->cnt;
+
+    for (input = 0; input < MATCH_INPUT_CNT; input++)
+    {
+        if (!bucket->matchers[input])
+            continue;
+
+        assert(inputs[input]);
+
+        regexCnt = matchRuleSetAutomaton(bucket->matchers[input],
+                                         inputs[input],
+                                         matches);
+
+        for (ii = 0; ii < regexCnt; ii++)
+        {
+            matched[matches[ii]] |= ENTRY_MATCHED;
+
+            if ((entries[matches[ii]].flags & RULE_FLAG_STOP)
+                && matches[ii] < cutoff)
+            {
+                cutoff = matches[ii];
+            }
+        }
+
+        inputNanos = getPatternMatchNanos(bucket->matchers[input]);
+
+        for (ii = 0; ii < bucket->cnt; ii++)
+        {
+            if (entries[ii].input == input)
+                nanos[ii] = inputNanos[ii];
+        }
+    }
+
+    /* The remaining entries are evaluated on their own, the stop rules most
+    ** likely to match cheaply first. Entries after the cutoff are skipped.
+    */
+
+    if (!(++bucket->evalCnt % REORDER_INTERVAL))
+        orderBucket(table, bucket);
+
+    QueryPerformanceFrequency(&freq);
+
+    for (ii = 0; ii < bucket->expensiveCnt; ii++)
+    {
+        jj = order[ii];
+
+        if (jj > cutoff
+            || ((entries[jj].flags & RULE_FLAG_SCOPED)
+                && !(matched[jj] & ENTRY_IN_SCOPE)))
+        {
+            nanos[jj] = RULE_NOT_EVALUATED;
+            continue;
+        }
+
+        QueryPerformanceCounter(&start);
+
+        /* Scoped regexes are matched on their own, a regex which runs out of
+        ** its budget doesn't match.
+        */
+
+        input = entries[jj].input;
+
+        if (entries[jj].glob)
+        {
+            res = isGlobMatch(entries[jj].glob, path);
+        }
+        else if (entries[jj].flags & RULE_FLAG_SCOPED)
+        {
+            res = isMatch(entries[jj].matcher, inputs[input]) > 0;
+        }
+        else
+        {
+            res = matchFallbackPattern(bucket->matchers[input],
+                                       inputs[input],
+                                       jj);
+        }
+
+        QueryPerformanceCounter(&end);
+
+        nanos[jj] = (end.QuadPart - start.QuadPart) * 1000000000ULL
+                    / freq.QuadPart;
+
+        if (res)
+        {
+            matched[jj] |= ENTRY_MATCHED;
+
+            if ((entries[jj].flags & RULE_FLAG_STOP) && jj < cutoff)
+                cutoff = jj;
+        }
+    }
+
+    matchCnt = 0;
+
+    for (ii = 0; ii < bucket->cnt && ii <= cutoff; ii++)
+    {
+        if (matched[ii] & ENTRY_MATCHED)
+            matches[matchCnt++] = bucket->first + ii;
+    }
+
+    return matchCnt;
+}
+
+int compileBuckets(RuleTable *table)
+{
+    const wchar_t **patterns;
+    const wchar_t **inputPatterns;
+    const wchar_t **scopes;
+    const Matcher **matchers;
+    const RuleEntry *entry;
+    RuleBucket *bucket;
+    bool scoped;
+    size_t patternCnt;
+    size_t ii;
+    size_t jj;
+    int input;
+
+    if (!table->cnt)
+        return 0;
+
+    if (!(patterns = allocMem(table->cnt * sizeof *patterns)))
+    {
+        /* TODO error */
+        goto fail_patterns;
+    }
+    if (!(matchers = allocMem(table->cnt * sizeof *matchers)))
+    {
+        /* TODO error */
+        goto fail_matchers;
+    }
+    if (!(scopes = allocMem(table->cnt * sizeof *scopes)))
+    {
+        /* TODO error */
+        goto fail_scopes;
+    }
+    if (!(inputPatterns = allocMem(table->cnt * sizeof *inputPatterns)))
+    {
+        /* TODO error */
+        goto fail_input_patterns;
+    }
+
+    /* Scoped regexes are left out of the combined automaton, so they are
+    ** only matched against the paths in their scope.
+    */
+
+    for (ii = 0; ii < table->cnt; ii++)
+    {
+        if (table->entries[ii].flags & RULE_FLAG_SCOPED)
+        {
+            patterns[ii] = NULL;
+            scopes[ii] = table->rules[ii]->scope;
+        }
+        else
+        {
+            patterns[ii] = table->entries[ii].glob ? NULL
+                                                   : table->rules[ii]->regex;
+            scopes[ii] = NULL;
+        }
+
+        matchers[ii] = table->entries[ii].matcher;
+    }
+
+    for (ii = 0; ii < eventMapSize; ii++)
+    {
+        bucket = &table->buckets[ii];
+
+        if (!bucket->cnt)
+            continue;
+
+        scoped = false;
+
+        for (jj = 0; jj < bucket->cnt; jj++)
+        {
+            entry = &table->entries[bucket->first + jj];
+
+            if (scopes[bucket->first + jj])
+                scoped = true;
+            if (!entry->glob)
+                bucket->inputs |= 1U << entry->input;
+        }
+
+        /* Every input gets an automaton of its own over the regexes which
+        ** are matched against it.
+        */
+
+        for (input = 0; input < MATCH_INPUT_CNT; input++)
+        {
+            patternCnt = 0;
+
+            for (jj = bucket->first; jj < bucket->first + bucket->cnt; jj++)
+            {
+                inputPatterns[jj] = table->entries[jj].input == input
+                                    ? patterns[jj] : NULL;
+                patternCnt += inputPatterns[jj] != NULL;
+            }
+
+            if (!patternCnt)
+                continue;
+
+            if (!(bucket->matchers[input] = compileRuleSetMatcher(
+                      &inputPatterns[bucket->first],
+                      &matchers[bucket->first],
+                      bucket->cnt)))
+            {
+                /* TODO error */
+                goto fail_compile;
+            }
+        }
+
+        for (jj = 0; jj < bucket->cnt; jj++)
+        {
+            entry = &table->entries[bucket->first + jj];
+
+            if (entry->glob
+                || scopes[bucket->first + jj]
+                || isFallbackPattern(bucket->matchers[entry->input], jj))
+            {
+                table->order[bucket->first + bucket->expensiveCnt++] = jj;
+            }
+        }
+
+        if (scoped
+            && !(bucket->scopes = buildScopeTrie(&scopes[bucket->first],
+                                                 bucket->cnt)))
+        {
+            /* TODO error */
+            goto fail_compile;
+        }
+
+        orderBucket(table, bucket);
+    }
+
+    freeMem(inputPatterns);
+    freeMem(scopes);
+    freeMem(matchers);
+    freeMem(patterns);
+
+    return 0;
+
+    /* The matchers and tries built so far are freed along with the table. */
+
+fail_compile:
+    freeMem(inputPatterns);
+fail_input_patterns:
+    freeMem(scopes);
+fail_scopes:
+    freeMem(matchers);
+fail_matchers:
+    freeMem(patterns);
+fail_patterns:
+    return 1;
+}
+
+void orderBucket(RuleTable *table, RuleBucket *bucket)
+{
+    sortTable = table;
+    sortBucket = bucket;
+
+    qsort(&table->order[bucket->first], bucket->expensiveCnt,
+          sizeof *table->order, compareOrder);
+}
+
+int compareOrder(const void *index1, const void *index2)
+{
+    size_t entry1;
+    size_t entry2;
+    bool stop1;
+    bool stop2;
+    double score1;
+    double score2;
+
+    entry1 = sortBucket->first + *(const size_t*) index1;
+    entry2 = sortBucket->first + *(const size_t*) index2;
+    stop1 = sortTable->entries[entry1].flags & RULE_FLAG_STOP;
+    stop2 = sortTable->entries[entry2].flags & RULE_FLAG_STOP;
+
+    /* Only stop rules can save evaluations, the other entries are evaluated
+    ** in rule order after them.
+    */
+
+    if (stop1 != stop2)
+        return stop1 ? -1 : 1;
+
+    if (stop1)
+    {
+        score1 = getEntryScore(sortTable, entry1);
+        score2 = getEntryScore(sortTable, entry2);
+
+        if (score1 != score2)
+            return score1 > score2 ? -1 : 1;
+    }
+
+    return (entry1 > entry2) - (entry1 < entry2);
+}
+
+double getEntryScore(const RuleTable *table, size_t index)
+{
+    const RuleStats *stats;
+    double nanos;
+    double rate;
+
+    /* The chance of a match per nanosecond spent. Rules which never matched
+    ** so far keep a small chance.
+    */
+
+    stats = &table->rules[index]->stats;
+
+    assert(stats->matchCnt <= stats->evalCnt);
+
+    if (stats->evalCnt)
+        nanos = (double) stats->totalNanos / stats->evalCnt;
+    else if (table->entries[index].glob)
+        nanos = DEFAULT_GLOB_NANOS;
+    else
+        nanos = DEFAULT_REGEX_NANOS;
+
+    rate = (stats->matchCnt + 1.0) / (stats->evalCnt + 2.0);
+
+    return rate / (nanos + 1.0);
+}
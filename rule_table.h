@@ -0,0 +1,183 @@
+/*
+This file is part of NppEventExec
+Copyright (C) 2016-2017 Mihail Ivanchev
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef __RULE_TABLE_H__
+#define __RULE_TABLE_H__
+
+/** The rule is executed in the background. */
+#define RULE_FLAG_BACKGROUND 0x01
+
+/** No further rules are executed once the rule matches. */
+#define RULE_FLAG_STOP 0x02
+
+/** The rule only applies to the files in its directory scope. */
+#define RULE_FLAG_SCOPED 0x04
+
+/**
+ * The number of strings the regexes of the rules are matched against: every
+ * match target of the path of the document and of its canonical form, see
+ * getCanonicalBufferPath. The input of a regex is its MatchTarget, plus
+ * MATCH_TARGET_CNT if the rule matches the canonical path.
+ */
+#define MATCH_INPUT_CNT (2 * MATCH_TARGET_CNT)
+
+/** Reported by matchRuleBucket for entries it didn't have to evaluate. */
+#define RULE_NOT_EVALUATED ((unsigned long long) -1)
+
+/**
+ * The data of an enabled rule which is accessed for every notification. The
+ * name and the command of the rule are only needed once the rule matches and
+ * are kept apart in RuleTable::rules.
+ */
+typedef struct
+{
+    unsigned int event;
+    unsigned int flags;
+    unsigned int input;
+    struct _Matcher *matcher;
+    struct _GlobMatcher *glob;
+} RuleEntry;
+
+/**
+ * The range of entries in the rule table which belong to a single event and
+ * the regexes of those entries compiled into a single matcher per match
+ * input, see MATCH_INPUT_CNT. RuleBucket::matchers[input] is NULL if no regex
+ * of the bucket is matched against the input, bit input of
+ * RuleBucket::inputs is set otherwise. Entries with a glob list or a scope are left out of the
+ * matchers, RuleBucket::globCnt is the number of the former. The scopes of the
+ * bucket are kept in RuleBucket::scopes, which is NULL if no entry has one.
+ *
+ * The entries which have to be evaluated on their own, i.e. those with a glob
+ * list or a scope and those whose regex the combined automaton doesn't
+ * support, are listed in RuleTable::order starting at RuleBucket::first in
+ * the order in which they are evaluated. RuleBucket::expensiveCnt is their
+ * number and RuleBucket::evalCnt counts the evaluations of the bucket.
+ */
+typedef struct
+{
+    size_t first;
+    size_t cnt;
+    size_t globCnt;
+    size_t expensiveCnt;
+    unsigned long evalCnt;
+    unsigned int inputs;
+    struct _RuleSetMatcher *matchers[MATCH_INPUT_CNT];
+    struct _ScopeTrie *scopes;
+} RuleBucket;
+
+/**
+ * The enabled rules grouped by event. The entries of each bucket are stored
+ * contiguously and in the order in which the rules were defined by the user.
+ * RuleTable::entries and RuleTable::rules are parallel arrays. Bit
+ * (event - NPPN_FIRST) of RuleTable::events is set if the bucket of the event
+ * is not empty. RuleTable::gen is different for every table built, so results
+ * derived from a table can be told apart from those of a newer one.
+ * RuleTable::order holds the evaluation order of every bucket, see RuleBucket,
+ * and RuleTable::matched is scratch space for matchRuleBucket.
+ */
+typedef struct
+{
+    RuleBucket *buckets;
+    RuleEntry *entries;
+    Rule **rules;
+    size_t *order;
+    unsigned char *matched;
+    size_t cnt;
+    unsigned long events;
+    unsigned long gen;
+} RuleTable;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Builds the rule table for a list of rules. The table references the
+ * rules, so it has to be freed before them.
+ * \param rules the rules to build the table for.
+ * \return the rule table or NULL upon an error.
+ */
+RuleTable* buildRuleTable(Rule *rules);
+
+void freeRuleTable(RuleTable *table);
+
+/**
+ * Returns the bucket of an event.
+ * \param table the rule table.
+ * \param event the code of the event, e.g. NPPN_FILESAVED.
+ * \return the bucket or NULL if the event is not supported.
+ */
+RuleBucket* getRuleBucket(RuleTable *table, unsigned int event);
+
+/**
+ * Checks whether any enabled rule is executed on an event. Meant to be called
+ * before doing any work for a notification.
+ * \param table the rule table.
+ * \param event the code of the event, e.g. NPPN_FILESAVED.
+ * \return non-zero if the event has rules, 0 otherwise.
+ */
+int isEventSubscribed(const RuleTable *table, unsigned int event);
+
+/**
+ * Counts the entries of a bucket whose regexes ran out of their budget, see
+ * isPatternAborted.
+ * \param bucket the bucket.
+ * \return the number of aborted entries.
+ */
+size_t getAbortedEntryCount(const RuleBucket *bucket);
+
+/**
+ * Checks whether the regex of an entry of a bucket ran out of its budget.
+ * \param table the rule table.
+ * \param bucket the bucket of the entry.
+ * \param index the index of the entry in the bucket.
+ * \return non-zero if the regex was aborted, 0 otherwise.
+ */
+int isEntryAborted(const RuleTable *table,
+                   const RuleBucket *bucket,
+                   size_t index);
+
+/**
+ * Finds the entries of a bucket which match a path, either by their regex or
+ * by their glob list. The regex of an entry is matched against its match
+ * input, the glob list and the scope against the whole original path.
+ * Entries with RULE_FLAG_SCOPED are only evaluated if their scope contains
+ * the path. Entries after the first matching entry with
+ * RULE_FLAG_STOP are left out; as far as possible they aren't even evaluated.
+ * \param table the rule table.
+ * \param bucket the bucket of the rule table to check.
+ * \param inputs the match inputs of the path to check, see MATCH_INPUT_CNT.
+ *        Only the inputs in RuleBucket::inputs and the original path at
+ *        MATCH_TARGET_PATH are needed, the others may be NULL.
+ * \param matches receives the indices of the matching entries in the table in
+ *        ascending order. Must have room for all entries of the bucket.
+ * \param nanos receives the time in nanoseconds spent on each entry of the
+ *        bucket, see getPatternMatchNanos, or RULE_NOT_EVALUATED. Must have
+ *        room for all entries of the bucket.
+ * \return the number of matching entries.
+ */
+size_t matchRuleBucket(RuleTable *table,
+                       RuleBucket *bucket,
+                       const wchar_t *const *inputs,
+                       size_t *matches,
+                       unsigned long long *nanos);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __RULE_TABLE_H__ */
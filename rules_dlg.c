@@ -22,12 +22,14 @@ along with this program. If not, see <http://www.gnu.org/licenses/>.
 #include "plugin.h"
 #include "resource.h"
 #include "rule.h"
+#include "rule_table.h"
 #include "rules_dlg.h"
 #include "edit_dlg.h"
 #include "util.h"
 #include "Notepad_plus_msgs.h"
 #include "Scintilla.h"
 #include "exec.h"
+#include "rate_limit.h"
 #include "queue_dlg.h"
 
 /** TODO */
@@ -42,16 +44,43 @@ typedef enum
     COL_EVENT,
     COL_NAME,
     COL_REGEX,
+    COL_TARGET,
+    COL_CANONICAL,
+    COL_GLOB,
+    COL_SCOPE,
     COL_CMD,
-    COL_BACKGROUND
+    COL_BACKGROUND,
+    COL_STOP,
+    COL_COALESCE,
+    COL_RATE_LIMIT,
+    COL_PRIORITY,
+    COL_EVAL_CNT,
+    COL_MATCH_CNT,
+    COL_TOTAL_TIME,
+    COL_MAX_TIME,
+    COL_EXEC_CNT
 } Column;
 
+/* A row of the list view while it's sorted by a column. ViewItem::pos is the
+** position of the rule in the list, which decides ties.
+*/
+
+typedef struct
+{
+    Rule *rule;
+    int pos;
+} ViewItem;
+
 typedef struct
 {
     Rule **activeRules;
+    RuleTable **activeTable;
     Rule *rules;
     Rule *lastRule;
     unsigned int ruleCnt;
+    ViewItem *view;
+    int sortCol;
+    bool sortDesc;
     bool initialized;
     bool modified;
     HWND handle;
@@ -65,6 +94,7 @@ typedef struct
     LONG clientHeight;
     HWND btnReset;
     HWND btnSave;
+    HWND btnResetStats;
     HWND btnClose;
     HIMAGELIST ilButtons;
     HIMAGELIST ilButtonsDisabled;
@@ -75,7 +105,9 @@ static void onInitDlg(HWND dlg);
 static void onSize(LONG clientWidth, LONG clientHeight);
 static void onGetDispInfo(NMLVDISPINFO *dispInfo);
 static void onItemChanged(NMLISTVIEW *info);
+static void onColumnClick(NMLISTVIEW *info);
 static void onReset(void);
+static void onResetStats(void);
 static void onSave(void);
 static void onMoveUp(void);
 static void onMoveDown(void);
@@ -96,14 +128,18 @@ static void deselectRule(int pos);
 static void selectRule(int pos);
 static void setModified(bool modified);
 static void askToSaveChanges(void);
+static Rule* getViewRule(int pos);
+static bool updateView(void);
+static int compareViewItems(const void *item1, const void *item2);
 
 static Dialog *dlg;
 
-int openRulesDlg(Rule **activeRules)
+int openRulesDlg(Rule **activeRules, RuleTable **activeTable)
 {
     INT_PTR res;
 
     assert(activeRules);
+    assert(activeTable);
 
     if (!(dlg = allocMem(sizeof *dlg)))
     {
@@ -112,7 +148,11 @@ int openRulesDlg(Rule **activeRules)
     }
 
     dlg->activeRules = activeRules;
+    dlg->activeTable = activeTable;
     dlg->rules = NULL;
+    dlg->view = NULL;
+    dlg->sortCol = -1;
+    dlg->sortDesc = false;
     dlg->initialized = false;
 
     res = DialogBoxW(getPluginInstance(), MAKEINTRESOURCE(IDD_RULES),
@@ -143,6 +183,7 @@ INT_PTR CALLBACK dlgProc(HWND handle, UINT msg, WPARAM wp, LPARAM lp)
         if (dlg->initialized)
         {
             freeRules(dlg->rules);
+            freeMem(dlg->view);
             ImageList_Destroy(dlg->ilButtons);
             ImageList_Destroy(dlg->ilButtonsDisabled);
         }
@@ -197,6 +238,9 @@ INT_PTR CALLBACK dlgProc(HWND handle, UINT msg, WPARAM wp, LPARAM lp)
         case IDC_BT_SAVE:
             onSave();
             DLGPROC_RESULT(handle, 0);
+        case IDC_BT_RESET_STATS:
+            onResetStats();
+            DLGPROC_RESULT(handle, 0);
         case IDCANCEL:
             askToSaveChanges();
             DLGPROC_RESULT(handle, 0);
@@ -221,6 +265,10 @@ INT_PTR CALLBACK dlgProc(HWND handle, UINT msg, WPARAM wp, LPARAM lp)
             case LVN_GETDISPINFO:
                 onGetDispInfo((NMLVDISPINFO*) lp);
                 break;
+
+            case LVN_COLUMNCLICK:
+                onColumnClick((NMLISTVIEW*) lp);
+                break;
             }
             break;
         } /* switch (LOWORD(wp)) */
@@ -345,6 +393,7 @@ void onInitDlg(HWND handle)
 
     dlg->btnReset = GetDlgItem(handle, IDC_BT_RESET);
     dlg->btnSave = GetDlgItem(handle, IDC_BT_SAVE);
+    dlg->btnResetStats = GetDlgItem(handle, IDC_BT_RESET_STATS);
     dlg->btnClose = GetDlgItem(handle, IDCANCEL);
 
     addListViewColumns(dlg->lvRules, (ListViewColumn[]) {
@@ -352,8 +401,21 @@ void onInitDlg(HWND handle)
         {COL_NAME, L"Name"},
         {COL_EVENT, L"Event"},
         {COL_REGEX, L"Regex"},
+        {COL_TARGET, L"Target"},
+        {COL_CANONICAL, L"Canonical?"},
+        {COL_GLOB, L"Glob"},
+        {COL_SCOPE, L"Scope"},
         {COL_CMD, L"Command"},
         {COL_BACKGROUND, L"Background?"},
+        {COL_STOP, L"Stop?"},
+        {COL_COALESCE, L"Coalesce"},
+        {COL_RATE_LIMIT, L"Rate limit"},
+        {COL_PRIORITY, L"Priority"},
+        {COL_EVAL_CNT, L"Evaluations"},
+        {COL_MATCH_CNT, L"Matches"},
+        {COL_TOTAL_TIME, L"Total time (\x00B5s)"},
+        {COL_MAX_TIME, L"Max. time (\x00B5s)"},
+        {COL_EXEC_CNT, L"Executions"},
         {-1}
     });
 
@@ -399,6 +461,7 @@ void onSize(LONG clientWidth, LONG clientHeight)
     RECT lvRulesRc;
     RECT btnSaveRc;
     RECT btnResetRc;
+    RECT btnResetStatsRc;
     RECT btnCloseRc;
     LONG offsWidth;
     LONG offsHeight;
@@ -416,15 +479,18 @@ void onSize(LONG clientWidth, LONG clientHeight)
     GetWindowRect(dlg->lvRules, &lvRulesRc);
     GetWindowRect(dlg->btnSave, &btnSaveRc);
     GetWindowRect(dlg->btnReset, &btnResetRc);
+    GetWindowRect(dlg->btnResetStats, &btnResetStatsRc);
     GetWindowRect(dlg->btnClose, &btnCloseRc);
     MapWindowPoints(NULL, dlg->handle, (POINT*) &btnSaveRc, 2);
     MapWindowPoints(NULL, dlg->handle, (POINT*) &btnResetRc, 2);
+    MapWindowPoints(NULL, dlg->handle, (POINT*) &btnResetStatsRc, 2);
     MapWindowPoints(NULL, dlg->handle, (POINT*) &btnCloseRc, 2);
 
     lvRulesWidth = lvRulesRc.right - lvRulesRc.left + offsWidth;
     lvRulesHeight = lvRulesRc.bottom - lvRulesRc.top + offsHeight;
     btnSaveRc.top += offsHeight;
     btnResetRc.top += offsHeight;
+    btnResetStatsRc.top += offsHeight;
     btnCloseLeft = clientWidth / 2
                    - (btnCloseRc.right - btnCloseRc.left) / 2;
     btnCloseTop = btnCloseRc.top + offsHeight;
@@ -439,6 +505,8 @@ void onSize(LONG clientWidth, LONG clientHeight)
         sizeWnd(dlg->lvRules, lvRulesWidth, lvRulesHeight),
         positionWnd(dlg->btnSave, btnSaveRc.left, btnSaveRc.top),
         positionWnd(dlg->btnReset, btnResetRc.left, btnResetRc.top),
+        positionWnd(dlg->btnResetStats, btnResetStatsRc.left,
+                    btnResetStatsRc.top),
         positionWnd(dlg->btnClose, btnCloseLeft, btnCloseTop),
         {NULL}
     });
@@ -450,7 +518,7 @@ void onGetDispInfo(NMLVDISPINFO *dispInfo)
     Rule *rule;
 
     item = &dispInfo->item;
-    rule = getRuleAt(dlg->rules, item->iItem);
+    rule = getViewRule(item->iItem);
 
     switch (item->iSubItem)
     {
@@ -466,12 +534,66 @@ void onGetDispInfo(NMLVDISPINFO *dispInfo)
     case COL_REGEX:
         item->pszText = rule->regex;
         break;
+    case COL_TARGET:
+        item->pszText = (wchar_t*) getMatchTargetName(rule->target);
+        break;
+    case COL_CANONICAL:
+        item->pszText = BOOL_TO_STR_YES_NO(rule->canonical);
+        break;
+    case COL_GLOB:
+        item->pszText = rule->glob;
+        break;
+    case COL_SCOPE:
+        item->pszText = rule->scope;
+        break;
     case COL_CMD:
         item->pszText = rule->cmd;
         break;
     case COL_BACKGROUND:
         item->pszText = BOOL_TO_STR_YES_NO(rule->background);
         break;
+    case COL_STOP:
+        item->pszText = BOOL_TO_STR_YES_NO(rule->stop);
+        break;
+    case COL_COALESCE:
+        item->pszText = (wchar_t*) getCoalescePolicyName(rule->coalesce);
+        break;
+    case COL_RATE_LIMIT:
+        if (rule->rateLimit == RATE_LIMIT_NONE)
+            item->pszText = (wchar_t*) getRateLimitName(rule->rateLimit);
+        else
+        {
+            StringCchPrintfW(item->pszText, item->cchTextMax, L"%ls, %u ms",
+                             getRateLimitName(rule->rateLimit),
+                             rule->rateWindow);
+        }
+        break;
+    case COL_PRIORITY:
+        item->pszText = (wchar_t*) getPriorityName(rule->priority);
+        break;
+
+    /* The statistics are formatted into the buffer of the list view. */
+
+    case COL_EVAL_CNT:
+        StringCchPrintfW(item->pszText, item->cchTextMax, L"%llu",
+                         rule->stats.evalCnt);
+        break;
+    case COL_MATCH_CNT:
+        StringCchPrintfW(item->pszText, item->cchTextMax, L"%llu",
+                         rule->stats.matchCnt);
+        break;
+    case COL_TOTAL_TIME:
+        StringCchPrintfW(item->pszText, item->cchTextMax, L"%.1f",
+                         rule->stats.totalNanos / 1000.0);
+        break;
+    case COL_MAX_TIME:
+        StringCchPrintfW(item->pszText, item->cchTextMax, L"%.1f",
+                         rule->stats.maxNanos / 1000.0);
+        break;
+    case COL_EXEC_CNT:
+        StringCchPrintfW(item->pszText, item->cchTextMax, L"%llu",
+                         rule->stats.execCnt);
+        break;
     }
 }
 
@@ -481,21 +603,60 @@ void onItemChanged(NMLISTVIEW *info)
     bool singleSelected;
     bool firstSelected;
     bool lastSelected;
+    bool sorted;
+
+    /* The rules can only be rearranged while they are shown in order. */
 
+    sorted = dlg->view != NULL;
     selectedCnt = ListView_GetSelectedCount(dlg->lvRules);
     singleSelected = selectedCnt == 1 && (info->uNewState & LVIS_SELECTED);
     firstSelected = singleSelected && !info->iItem;
     lastSelected = singleSelected
                    && ((unsigned int) info->iItem == dlg->ruleCnt - 1);
 
-    setToolbarBtnEnabled(ID_RULE_MOVEUP, singleSelected && !firstSelected);
-    setToolbarBtnEnabled(ID_RULE_MOVEDOWN, singleSelected && !lastSelected);
+    setToolbarBtnEnabled(ID_RULE_MOVEUP,
+                         singleSelected && !firstSelected && !sorted);
+    setToolbarBtnEnabled(ID_RULE_MOVEDOWN,
+                         singleSelected && !lastSelected && !sorted);
     setToolbarBtnEnabled(ID_RULE_COPY,
-                         singleSelected && dlg->ruleCnt < INT_MAX);
-    setToolbarBtnEnabled(ID_RULE_REMOVE, selectedCnt);
+                         singleSelected && dlg->ruleCnt < INT_MAX && !sorted);
+    setToolbarBtnEnabled(ID_RULE_REMOVE, selectedCnt && !sorted);
     setToolbarBtnEnabled(ID_RULE_EDIT, singleSelected);
 }
 
+void onColumnClick(NMLISTVIEW *info)
+{
+    LVCOLUMN col;
+
+    col.mask = LVCF_SUBITEM;
+
+    if (!ListView_GetColumn(dlg->lvRules, info->iSubItem, &col))
+    {
+        /* TODO error */
+        return;
+    }
+
+    /* Clicking a column sorts the rules ascending, then descending and then
+    ** shows them in order again.
+    */
+
+    if (col.iSubItem != dlg->sortCol)
+    {
+        dlg->sortCol = col.iSubItem;
+        dlg->sortDesc = false;
+    }
+    else if (!dlg->sortDesc)
+        dlg->sortDesc = true;
+    else
+        dlg->sortCol = -1;
+
+    if (!updateView())
+    {
+        /* TODO error */
+        errorMsgBox(dlg->handle, L"Failed to sort the rules.");
+    }
+}
+
 void onReset(void)
 {
     int choice;
@@ -528,6 +689,23 @@ void onReset(void)
     SetFocus(dlg->lvRules);
 }
 
+void onResetStats(void)
+{
+    /* The statistics aren't saved, so resetting them doesn't modify the
+    ** rules.
+    */
+
+    resetRuleStats(*dlg->activeRules);
+    resetRuleStats(dlg->rules);
+
+    if (dlg->view && dlg->sortCol >= COL_EVAL_CNT && !updateView())
+    {
+        /* TODO error */
+    }
+
+    InvalidateRect(dlg->lvRules, NULL, FALSE);
+}
+
 void onSave(void)
 {
     if (saveRules())
@@ -621,10 +799,18 @@ void onAdd(void)
     template = (Rule) {
         .name = L"New rule",
         .regex = L".*",
+        .glob = L"",
+        .scope = L"",
+        .target = MATCH_TARGET_PATH,
+        .coalesce = COALESCE_NEVER,
+        .rateLimit = RATE_LIMIT_NONE,
+        .rateWindow = 0,
+        .priority = PRIORITY_DEFAULT,
         .cmd = L"Sample command",
         .event = NPPN_FILEBEFORESAVE,
         .enabled = 0,
         .background = 0,
+        .stop = 0,
         .next = NULL
     };
 
@@ -794,7 +980,7 @@ void onEdit(void)
     Rule *rule;
 
     pos = ListView_GetNextItem(dlg->lvRules, -1, LVNI_SELECTED);
-    rule = getRuleAt(dlg->rules, pos);
+    rule = getViewRule(pos);
 
     if ((res = openEditDlg(dlg->handle, rule)) < 0)
     {
@@ -906,12 +1092,25 @@ void layoutDlg(void)
     EnumChildWindows(dlg->handle, layoutDlgProc, toolbarWidth);
 
     sizeListViewColumns(dlg->lvRules, (ListViewColumnSize[]) {
-        {COL_ENABLED, 0.08},
-        {COL_NAME, 0.20},
-        {COL_EVENT, 0.20},
-        {COL_REGEX, 0.20},
-        {COL_CMD, 0.24},
-        {COL_BACKGROUND, 0.08},
+        {COL_ENABLED, 0.04},
+        {COL_NAME, 0.07},
+        {COL_EVENT, 0.07},
+        {COL_REGEX, 0.06},
+        {COL_TARGET, 0.04},
+        {COL_CANONICAL, 0.04},
+        {COL_GLOB, 0.04},
+        {COL_SCOPE, 0.05},
+        {COL_CMD, 0.06},
+        {COL_BACKGROUND, 0.04},
+        {COL_STOP, 0.04},
+        {COL_COALESCE, 0.05},
+        {COL_RATE_LIMIT, 0.06},
+        {COL_PRIORITY, 0.04},
+        {COL_EVAL_CNT, 0.06},
+        {COL_MATCH_CNT, 0.06},
+        {COL_TOTAL_TIME, 0.06},
+        {COL_MAX_TIME, 0.06},
+        {COL_EXEC_CNT, 0.06},
         {-1}
     });
 }
@@ -927,6 +1126,7 @@ BOOL CALLBACK layoutDlgProc(HWND wnd, LPARAM lp)
     case IDC_LV_RULES:
     case IDC_BT_SAVE:
     case IDC_BT_RESET:
+    case IDC_BT_RESET_STATS:
         MapWindowPoints(NULL, dlg->handle, (POINT*) &rc.left, 1);
         setWndPos(wnd, rc.left + (int) lp, rc.top + dlg->padding);
         break;
@@ -962,18 +1162,22 @@ bool resetRules(void)
     dlg->ruleCnt = getRuleCount(dlg->rules);
 
     ListView_SetItemCount(dlg->lvRules, dlg->ruleCnt);
-    setToolbarBtnEnabled(ID_RULE_ADD, dlg->ruleCnt < INT_MAX);
     EnableWindow(dlg->btnReset, FALSE);
     EnableWindow(dlg->btnSave, FALSE);
     setModified(false);
 
-    return true;
+    /* The sort order is kept. This also enables the add button if the rules
+    ** are shown in order.
+    */
+
+    return updateView();
 }
 
 bool saveRules(void)
 {
     Rule *rules;
     Rule *lastRule;
+    RuleTable *table;
     INT_PTR res;
 
     if (!isQueueEmpty())
@@ -994,18 +1198,32 @@ bool saveRules(void)
         goto fail_copy;
     }
 
+    if (!(table = buildRuleTable(rules)))
+    {
+        /* TODO error */
+        goto fail_table;
+    }
     if (writeRules(dlg->rules))
     {
         /* TODO error */
         goto fail_write;
     }
 
+    /* The table and the deferred executions reference the rules so free them
+    ** first.
+    */
+
+    cancelDeferredExecs();
+    freeRuleTable(*dlg->activeTable);
     freeRules(*dlg->activeRules);
+    *dlg->activeTable = table;
     *dlg->activeRules = rules;
 
     return true;
 
 fail_write:
+    freeRuleTable(table);
+fail_table:
     freeRules(rules);
 fail_copy:
 fail_dlg:
@@ -1081,3 +1299,179 @@ void askToSaveChanges(void)
         break;
     }
 }
+
+Rule* getViewRule(int pos)
+{
+    return dlg->view ? dlg->view[pos].rule : getRuleAt(dlg->rules, pos);
+}
+
+bool updateView(void)
+{
+    HWND header;
+    HDITEM headerItem;
+    LVCOLUMN col;
+    Rule *rule;
+    bool sorted;
+    int cnt;
+    int ii;
+
+    freeMem(dlg->view);
+    dlg->view = NULL;
+    sorted = true;
+
+    if (dlg->sortCol != -1 && dlg->ruleCnt)
+    {
+        if (!(dlg->view = allocMem(dlg->ruleCnt * sizeof *dlg->view)))
+        {
+            /* TODO error */
+            dlg->sortCol = -1;
+            sorted = false;
+        }
+        else
+        {
+            for (rule = dlg->rules, ii = 0; rule; rule = rule->next, ii++)
+            {
+                dlg->view[ii].rule = rule;
+                dlg->view[ii].pos = ii;
+            }
+
+            qsort(dlg->view, dlg->ruleCnt, sizeof *dlg->view,
+                  compareViewItems);
+        }
+    }
+
+    /* Show the sort order in the header. */
+
+    header = ListView_GetHeader(dlg->lvRules);
+    cnt = Header_GetItemCount(header);
+
+    for (ii = 0; ii < cnt; ii++)
+    {
+        col.mask = LVCF_SUBITEM;
+        headerItem.mask = HDI_FORMAT;
+
+        if (!ListView_GetColumn(dlg->lvRules, ii, &col)
+            || !Header_GetItem(header, ii, &headerItem))
+        {
+            continue;
+        }
+
+        headerItem.fmt &= ~(HDF_SORTUP | HDF_SORTDOWN);
+
+        if (col.iSubItem == dlg->sortCol)
+            headerItem.fmt |= dlg->sortDesc ? HDF_SORTDOWN : HDF_SORTUP;
+
+        Header_SetItem(header, ii, &headerItem);
+    }
+
+    deselectAll();
+    setToolbarBtnEnabled(ID_RULE_ADD, !dlg->view && dlg->ruleCnt < INT_MAX);
+    InvalidateRect(dlg->lvRules, NULL, FALSE);
+
+    return sorted;
+}
+
+int compareViewItems(const void *item1, const void *item2)
+{
+    const ViewItem *view1;
+    const ViewItem *view2;
+    const Rule *rule1;
+    const Rule *rule2;
+    unsigned long long val1;
+    unsigned long long val2;
+    int res;
+
+    view1 = item1;
+    view2 = item2;
+    rule1 = view1->rule;
+    rule2 = view2->rule;
+    val1 = 0;
+    val2 = 0;
+    res = 0;
+
+    switch (dlg->sortCol)
+    {
+    case COL_ENABLED:
+        val1 = rule1->enabled;
+        val2 = rule2->enabled;
+        break;
+    case COL_EVENT:
+        res = lstrcmpiW(getEventMapEntry(rule1->event)->name,
+                        getEventMapEntry(rule2->event)->name);
+        break;
+    case COL_NAME:
+        res = lstrcmpiW(rule1->name, rule2->name);
+        break;
+    case COL_REGEX:
+        res = lstrcmpiW(rule1->regex, rule2->regex);
+        break;
+    case COL_TARGET:
+        val1 = rule1->target;
+        val2 = rule2->target;
+        break;
+    case COL_CANONICAL:
+        val1 = rule1->canonical;
+        val2 = rule2->canonical;
+        break;
+    case COL_GLOB:
+        res = lstrcmpiW(rule1->glob, rule2->glob);
+        break;
+    case COL_SCOPE:
+        res = lstrcmpiW(rule1->scope, rule2->scope);
+        break;
+    case COL_CMD:
+        res = lstrcmpiW(rule1->cmd, rule2->cmd);
+        break;
+    case COL_BACKGROUND:
+        val1 = rule1->background;
+        val2 = rule2->background;
+        break;
+    case COL_STOP:
+        val1 = rule1->stop;
+        val2 = rule2->stop;
+        break;
+    case COL_COALESCE:
+        val1 = rule1->coalesce;
+        val2 = rule2->coalesce;
+        break;
+    case COL_RATE_LIMIT:
+        val1 = rule1->rateLimit * (MAX_RATE_WINDOW_IN_MS + 1ULL)
+               + rule1->rateWindow;
+        val2 = rule2->rateLimit * (MAX_RATE_WINDOW_IN_MS + 1ULL)
+               + rule2->rateWindow;
+        break;
+    case COL_PRIORITY:
+        val1 = rule1->priority;
+        val2 = rule2->priority;
+        break;
+    case COL_EVAL_CNT:
+        val1 = rule1->stats.evalCnt;
+        val2 = rule2->stats.evalCnt;
+        break;
+    case COL_MATCH_CNT:
+        val1 = rule1->stats.matchCnt;
+        val2 = rule2->stats.matchCnt;
+        break;
+    case COL_TOTAL_TIME:
+        val1 = rule1->stats.totalNanos;
+        val2 = rule2->stats.totalNanos;
+        break;
+    case COL_MAX_TIME:
+        val1 = rule1->stats.maxNanos;
+        val2 = rule2->stats.maxNanos;
+        break;
+    case COL_EXEC_CNT:
+        val1 = rule1->stats.execCnt;
+        val2 = rule2->stats.execCnt;
+        break;
+    }
+
+    if (!res)
+        res = (val1 > val2) - (val1 < val2);
+    if (dlg->sortDesc)
+        res = -res;
+
+    /* Equal rules stay in order. */
+
+    return res ? res : view1->pos - view2->pos;
+}
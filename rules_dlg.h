@@ -29,12 +29,14 @@ extern "C" {
  *        by the plugin; the list will be overwritten by the dialog after the
  *        changes are confirmed and all currently scheduled rules are executed
  *        or or aborted.
- * \param rule the rule that the user will be editing.
+ * \param activeTable a pointer to a variable holding the rule table built
+ *        for the active rules; it's rebuilt whenever the active rules are
+ *        overwritten.
  * \return 1 when the dialog is closed.
  * \return 0 upon an error.
  * \return -1 upon an error.
  */
-int openRulesDlg(Rule **activeRules);
+int openRulesDlg(Rule **activeRules, RuleTable **activeTable);
 
 #ifdef __cplusplus
 }
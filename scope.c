@@ -0,0 +1,330 @@
+/*
+This file is part of NppEventExec
+Copyright (C) 2016-2017 Mihail Ivanchev
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "base.h"
+#include "mem.h"
+#include "util.h"
+#include "hash.h"
+#include "path_scan.h"
+#include "scope.h"
+
+/** Marks the absence of a child or a sibling. */
+#define NO_NODE ((size_t) -1)
+
+/**
+ * A directory component. The children of a node form a list linked through
+ * Node::sibling. The scopes which end at the node are listed in
+ * ScopeTrie::indices starting at Node::first.
+ */
+typedef struct
+{
+    const wchar_t *name;
+    size_t len;
+    size_t hash;
+    size_t child;
+    size_t sibling;
+    size_t first;
+    size_t cnt;
+} Node;
+
+/**
+ * The names of the nodes are folded and stored in ScopeTrie::buf. The root is
+ * ScopeTrie::nodes[0] and stands for the scopes without components.
+ */
+struct _ScopeTrie
+{
+    wchar_t *buf;
+    Node *nodes;
+    size_t nodeCnt;
+    size_t *indices;
+};
+
+static const wchar_t* nextComponent(const wchar_t **pos,
+                                    const wchar_t *end,
+                                    size_t *len);
+static size_t findChild(const ScopeTrie *trie,
+                        size_t node,
+                        const wchar_t *name,
+                        size_t len,
+                        size_t hash);
+
+ScopeTrie* buildScopeTrie(const wchar_t *const *scopes, size_t cnt)
+{
+    ScopeTrie *trie;
+    size_t *scopeNodes;
+    Node *node;
+    const wchar_t *pos;
+    const wchar_t *end;
+    const wchar_t *name;
+    wchar_t *dest;
+    size_t bufLen;
+    size_t len;
+    size_t hash;
+    size_t parent;
+    size_t child;
+    size_t first;
+    size_t ii;
+
+    assert(scopes);
+
+    bufLen = 0;
+
+    for (ii = 0; ii < cnt; ii++)
+    {
+        if (!scopes[ii])
+            continue;
+
+        len = wcslen(scopes[ii]);
+
+        if (len >= SIZE_MAX / sizeof(Node) - 1 - bufLen)
+        {
+            /* TODO error */
+            goto fail_too_long;
+        }
+
+        bufLen += len + 1;
+    }
+
+    if (!(trie = allocMem(sizeof *trie)))
+    {
+        /* TODO error */
+        goto fail_trie;
+    }
+    if (!(trie->buf = allocMem((bufLen + 1) * sizeof(wchar_t))))
+    {
+        /* TODO error */
+        goto fail_buf;
+    }
+
+    /* Every component takes at least one character of the buffer. */
+
+    if (!(trie->nodes = allocMem((bufLen + 1) * sizeof(Node))))
+    {
+        /* TODO error */
+        goto fail_nodes;
+    }
+    if (!(trie->indices = allocMem((cnt ? cnt : 1) * sizeof(size_t))))
+    {
+        /* TODO error */
+        goto fail_indices;
+    }
+    if (!(scopeNodes = allocMem((cnt ? cnt : 1) * sizeof(size_t))))
+    {
+        /* TODO error */
+        goto fail_scope_nodes;
+    }
+
+    trie->nodes[0].name = NULL;
+    trie->nodes[0].len = 0;
+    trie->nodes[0].hash = 0;
+    trie->nodes[0].child = NO_NODE;
+    trie->nodes[0].sibling = NO_NODE;
+    trie->nodes[0].cnt = 0;
+    trie->nodeCnt = 1;
+
+    dest = trie->buf;
+
+    for (ii = 0; ii < cnt; ii++)
+    {
+        if (!scopes[ii])
+        {
+            scopeNodes[ii] = NO_NODE;
+            continue;
+        }
+
+        pos = scopes[ii];
+        end = pos + wcslen(pos);
+        parent = 0;
+
+        while ((name = nextComponent(&pos, end, &len)))
+        {
+            hash = hashFoldedRange(FNV_OFFSET_BASIS, name, len);
+
+            if ((child = findChild(trie, parent, name, len, hash)) == NO_NODE)
+            {
+                child = trie->nodeCnt++;
+                node = &trie->nodes[child];
+                node->name = dest;
+                node->len = len;
+                node->hash = hash;
+                node->child = NO_NODE;
+                node->sibling = trie->nodes[parent].child;
+                node->cnt = 0;
+                trie->nodes[parent].child = child;
+
+                foldPathRange(dest, name, len);
+                dest += len;
+                *dest++ = L'\0';
+            }
+
+            parent = child;
+        }
+
+        scopeNodes[ii] = parent;
+        trie->nodes[parent].cnt++;
+    }
+
+    /* Assign every node its range of indices, then fill in the indices. The
+    ** second pass resets the counts so they can be used as insertion
+    ** positions.
+    */
+
+    first = 0;
+
+    for (ii = 0; ii < trie->nodeCnt; ii++)
+    {
+        trie->nodes[ii].first = first;
+        first += trie->nodes[ii].cnt;
+        trie->nodes[ii].cnt = 0;
+    }
+
+    for (ii = 0; ii < cnt; ii++)
+    {
+        if (scopeNodes[ii] == NO_NODE)
+            continue;
+
+        node = &trie->nodes[scopeNodes[ii]];
+        trie->indices[node->first + node->cnt++] = ii;
+    }
+
+    freeMem(scopeNodes);
+
+    return trie;
+
+fail_scope_nodes:
+    freeMem(trie->indices);
+fail_indices:
+    freeMem(trie->nodes);
+fail_nodes:
+    freeMem(trie->buf);
+fail_buf:
+    freeMem(trie);
+fail_trie:
+fail_too_long:
+    return NULL;
+}
+
+void freeScopeTrie(ScopeTrie *trie)
+{
+    if (!trie)
+        return;
+
+    freeMem(trie->indices);
+    freeMem(trie->nodes);
+    freeMem(trie->buf);
+    freeMem(trie);
+}
+
+int isValidScope(const wchar_t *scope)
+{
+    assert(scope);
+
+    return !wcspbrk(scope, L"*?\"<>|");
+}
+
+size_t findScopes(const ScopeTrie *trie, const wchar_t *path, size_t *indices)
+{
+    const Node *node;
+    const wchar_t *pos;
+    const wchar_t *end;
+    const wchar_t *name;
+    const wchar_t *sep;
+    size_t len;
+    size_t child;
+    size_t cnt;
+    size_t ii;
+
+    assert(trie);
+    assert(path);
+    assert(indices);
+
+    /* Only the directory of the path is walked, the filename is left out. */
+
+    sep = findLastSeparator(path, path + wcslen(path));
+    end = sep ? sep + 1 : path;
+
+    pos = path;
+    node = &trie->nodes[0];
+    cnt = 0;
+
+    for (;;)
+    {
+        for (ii = 0; ii < node->cnt; ii++)
+            indices[cnt++] = trie->indices[node->first + ii];
+
+        if (!(name = nextComponent(&pos, end, &len)))
+            break;
+
+        child = findChild(trie,
+                          node - trie->nodes,
+                          name,
+                          len,
+                          hashFoldedRange(FNV_OFFSET_BASIS, name, len));
+
+        if (child == NO_NODE)
+            break;
+
+        node = &trie->nodes[child];
+    }
+
+    return cnt;
+}
+
+const wchar_t* nextComponent(const wchar_t **pos,
+                             const wchar_t *end,
+                             size_t *len)
+{
+    const wchar_t *name;
+
+    while (*pos < end && (**pos == L'\\' || **pos == L'/'))
+        (*pos)++;
+
+    if (*pos == end)
+        return NULL;
+
+    name = *pos;
+    *pos = findSeparator(name, end);
+
+    *len = *pos - name;
+    return name;
+}
+
+size_t findChild(const ScopeTrie *trie,
+                 size_t node,
+                 const wchar_t *name,
+                 size_t len,
+                 size_t hash)
+{
+    const Node *child;
+    size_t index;
+
+    for (index = trie->nodes[node].child;
+         index != NO_NODE;
+         index = child->sibling)
+    {
+        child = &trie->nodes[index];
+
+        if (child->hash == hash
+            && child->len == len
+            && isFoldedRange(child->name, name, len))
+        {
+            return index;
+        }
+    }
+
+    return NO_NODE;
+}
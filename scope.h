@@ -0,0 +1,69 @@
+/*
+This file is part of NppEventExec
+Copyright (C) 2016-2017 Mihail Ivanchev
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef __SCOPE_H__
+#define __SCOPE_H__
+
+/**
+ * The directory scopes of a set of rules arranged as a trie keyed by the
+ * case-folded components of the directories. A path is looked up by walking
+ * its directory components once.
+ */
+typedef struct _ScopeTrie ScopeTrie;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Builds the trie for a list of scopes. A scope is a directory path whose
+ * components are separated by slashes or backslashes; separators at the
+ * start, at the end or repeated are ignored. A scope without components
+ * contains every path.
+ * \param scopes the scopes, NULL for the items which have no scope.
+ * \param cnt the number of items.
+ * \return the trie or NULL upon an error.
+ */
+ScopeTrie* buildScopeTrie(const wchar_t *const *scopes, size_t cnt);
+
+void freeScopeTrie(ScopeTrie *trie);
+
+/**
+ * Checks whether a string can be used as a scope, i.e. doesn't contain
+ * characters which can't be part of a directory path.
+ * \param scope the scope to check.
+ * \return non-zero if the scope is valid, 0 otherwise.
+ */
+int isValidScope(const wchar_t *scope);
+
+/**
+ * Finds the scopes which contain a path, i.e. those equal to the directory of
+ * the path or to one of its ancestors. The comparison is case-insensitive.
+ * \param trie the trie.
+ * \param path the path to check.
+ * \param indices receives the indices of the containing scopes in the list
+ *        the trie was built from, in no particular order. Must have room for
+ *        all items of the list.
+ * \return the number of containing scopes.
+ */
+size_t findScopes(const ScopeTrie *trie, const wchar_t *path, size_t *indices);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __SCOPE_H__ */
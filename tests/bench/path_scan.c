@@ -0,0 +1,257 @@
+/*
+This file is part of NppEventExec
+Copyright (C) 2016-2017 Mihail Ivanchev
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+/* Microbenchmark of the path scanning kernels against the per-character loops
+** they replaced. It runs on Linux x86-64 as well, see the Makefile next to
+** this file; it must be built with -fshort-wchar, otherwise wchar_t has 32
+** bits and path_scan.c silently falls back to its scalar loops.
+**
+** The Windows headers are kept out by defining the include guards of base.h
+** and util.h and providing the few definitions path_scan.c needs here.
+*/
+
+#define __BASE_H__
+#define __UTIL_H__
+
+#include <assert.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#define IS_PATH_SEPARATOR(chr) ((chr) == L'\\' || (chr) == L'/')
+
+wchar_t foldPathChar(wchar_t chr);
+
+#include "../../path_scan.c"
+
+#if WCHAR_MAX != 0xFFFF
+#error "wchar_t must have 16 bits, build with -fshort-wchar."
+#endif
+
+#ifndef USE_SSE2
+#error "The SSE2 kernels aren't enabled for this target."
+#endif
+
+/** The number of timed calls of every kernel. */
+#define ITERATION_CNT 5000000
+
+/** The maximum length of a benchmarked path. */
+#define MAX_PATH_LEN 127
+
+/** The number of benchmarked paths. */
+#define PATH_CNT (sizeof(paths) / sizeof(paths[0]))
+
+static const wchar_t* scalarFindSeparator(const wchar_t *str,
+                                          const wchar_t *end);
+static const wchar_t* scalarFindLastSeparator(const wchar_t *str,
+                                              const wchar_t *end);
+static void widen(wchar_t *dest, const char *src, size_t *len);
+static double getSeconds(void);
+static void report(const char *name, double scalarSecs, double kernelSecs);
+
+/* Typical paths of 60-80 code units, the last one has a non-ASCII code unit
+** which takes the fallback of the folding kernels. They're widened at run
+** time since printf can't show 16-bit wide strings.
+*/
+
+static const char *const paths[] = {
+    "C:\\Users\\someone\\Documents\\Projects\\NppEventExec\\src\\rule_table.c",
+    "D:\\repos\\projectX\\build\\Release\\obj\\x64\\generated\\parser.cpp",
+    "C:\\Program Files\\Notepad++\\plugins\\config\\NppEventExec_rules.csv",
+    "\\\\server\\share\\team\\documents\\2017\\reports\\\xC4nderungen-v3.docx"
+};
+
+static volatile size_t sink;
+
+int main(void)
+{
+    wchar_t strs[PATH_CNT][MAX_PATH_LEN + 1];
+    wchar_t folded[PATH_CNT][MAX_PATH_LEN + 1];
+    wchar_t buf[MAX_PATH_LEN + 1];
+    size_t lens[PATH_CNT];
+    const wchar_t *str;
+    const wchar_t *end;
+    double start;
+    double scalarSecs;
+    size_t ii;
+    size_t jj;
+    int equal;
+
+    for (ii = 0; ii < PATH_CNT; ii++)
+    {
+        widen(strs[ii], paths[ii], &lens[ii]);
+        foldPathRange(folded[ii], strs[ii], lens[ii]);
+
+        for (jj = 0; jj < lens[ii]; jj++)
+        {
+            if (folded[ii][jj] != foldPathChar(strs[ii][jj]))
+            {
+                fprintf(stderr, "Path %lu was folded incorrectly.\n",
+                        (unsigned long) ii);
+                return 1;
+            }
+        }
+    }
+
+    printf("%-16s %10s %10s\n", "", "scalar", "kernel");
+
+    start = getSeconds();
+    for (ii = 0; ii < ITERATION_CNT; ii++)
+    {
+        str = strs[ii % PATH_CNT];
+        sink += scalarFindLastSeparator(str, str + lens[ii % PATH_CNT]) - str;
+    }
+    scalarSecs = getSeconds() - start;
+
+    start = getSeconds();
+    for (ii = 0; ii < ITERATION_CNT; ii++)
+    {
+        str = strs[ii % PATH_CNT];
+        sink += findLastSeparator(str, str + lens[ii % PATH_CNT]) - str;
+    }
+    report("last separator", scalarSecs, getSeconds() - start);
+
+    start = getSeconds();
+    for (ii = 0; ii < ITERATION_CNT; ii++)
+    {
+        str = strs[ii % PATH_CNT];
+        end = str + lens[ii % PATH_CNT];
+
+        while (str < end)
+            str = scalarFindSeparator(str, end) + 1;
+
+        sink += str - end;
+    }
+    scalarSecs = getSeconds() - start;
+
+    start = getSeconds();
+    for (ii = 0; ii < ITERATION_CNT; ii++)
+    {
+        str = strs[ii % PATH_CNT];
+        end = str + lens[ii % PATH_CNT];
+
+        while (str < end)
+            str = findSeparator(str, end) + 1;
+
+        sink += str - end;
+    }
+    report("component walk", scalarSecs, getSeconds() - start);
+
+    start = getSeconds();
+    for (ii = 0; ii < ITERATION_CNT; ii++)
+    {
+        str = strs[ii % PATH_CNT];
+
+        for (jj = 0; jj < lens[ii % PATH_CNT]; jj++)
+            buf[jj] = foldPathChar(str[jj]);
+
+        sink += buf[0];
+    }
+    scalarSecs = getSeconds() - start;
+
+    start = getSeconds();
+    for (ii = 0; ii < ITERATION_CNT; ii++)
+    {
+        foldPathRange(buf, strs[ii % PATH_CNT], lens[ii % PATH_CNT]);
+        sink += buf[0];
+    }
+    report("fold", scalarSecs, getSeconds() - start);
+
+    start = getSeconds();
+    for (ii = 0; ii < ITERATION_CNT; ii++)
+    {
+        str = strs[ii % PATH_CNT];
+        equal = 1;
+
+        for (jj = 0; jj < lens[ii % PATH_CNT]; jj++)
+        {
+            if (folded[ii % PATH_CNT][jj] != foldPathChar(str[jj]))
+            {
+                equal = 0;
+                break;
+            }
+        }
+
+        sink += equal;
+    }
+    scalarSecs = getSeconds() - start;
+
+    start = getSeconds();
+    for (ii = 0; ii < ITERATION_CNT; ii++)
+    {
+        sink += isFoldedRange(folded[ii % PATH_CNT], strs[ii % PATH_CNT],
+                              lens[ii % PATH_CNT]);
+    }
+    report("folded compare", scalarSecs, getSeconds() - start);
+
+    return 0;
+}
+
+wchar_t foldPathChar(wchar_t chr)
+{
+    /* Like util.c, the Latin-1 capitals stand in for CharLowerW. */
+
+    if (chr == L'\\')
+        return L'/';
+    if (chr < 0x80)
+        return chr >= L'A' && chr <= L'Z' ? chr - L'A' + L'a' : chr;
+
+    return chr >= 0xC0 && chr <= 0xDE && chr != 0xD7 ? chr + 0x20 : chr;
+}
+
+const wchar_t* scalarFindSeparator(const wchar_t *str, const wchar_t *end)
+{
+    while (str < end && !IS_PATH_SEPARATOR(*str))
+        str++;
+
+    return str;
+}
+
+const wchar_t* scalarFindLastSeparator(const wchar_t *str,
+                                       const wchar_t *end)
+{
+    while (end > str && !IS_PATH_SEPARATOR(end[-1]))
+        end--;
+
+    return end > str ? end - 1 : NULL;
+}
+
+void widen(wchar_t *dest, const char *src, size_t *len)
+{
+    assert(strlen(src) <= MAX_PATH_LEN);
+
+    for (*len = 0; src[*len]; (*len)++)
+        dest[*len] = (unsigned char) src[*len];
+
+    dest[*len] = L'\0';
+}
+
+double getSeconds(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec * 1e-9;
+}
+
+void report(const char *name, double scalarSecs, double kernelSecs)
+{
+    printf("%-16s %7.1f ns %7.1f ns\n", name,
+           scalarSecs / ITERATION_CNT * 1e9, kernelSecs / ITERATION_CNT * 1e9);
+}
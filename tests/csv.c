@@ -31,6 +31,8 @@ along with this program. If not, see <http://www.gnu.org/licenses/>.
 #define HARNESS_ITERATIONS 256
 
 declare_assert(file_open, int fieldCnt, int header);
+declare_assert(file_open_variable, size_t minFieldCnt, size_t maxFieldCnt,
+               size_t fieldCnt);
 declare_assert(file_read);
 declare_assert(any_str_read);
 declare_assert(str_read, const wchar_t *val);
@@ -43,6 +45,8 @@ declare_assert(event_read, unsigned int val);
 
 #define assert_file_open(fieldCnt, header) \
     call_assert_proc(file_open, fieldCnt, header)
+#define assert_file_open_variable(minFieldCnt, maxFieldCnt, fieldCnt) \
+    call_assert_proc(file_open_variable, minFieldCnt, maxFieldCnt, fieldCnt)
 #define assert_file_read()    call_assert_proc(file_read)
 #define assert_any_str_read() call_assert_proc(any_str_read)
 #define assert_str_read(val)  call_assert_proc(str_read, val)
@@ -226,6 +230,27 @@ Test(csv, more_columns_than_expected) {
 
 }
 
+Test(csv, variable_columns) {
+    /* The header only determines the number of fields, it isn't read. */
+
+    assert_file_open_variable(2, 4, 3);
+    assert_str_read(L"four");
+    assert_str_read(L"five");
+    assert_str_read(L"six");
+    assert_file_read();
+}
+
+Test(csv, variable_columns_too_few) {
+    size_t cnt;
+
+    if (!csvOpenVariable(L"csv\\variable_columns_too_few.csv", 2, 4, &cnt))
+    {
+        csvClose();
+        cr_fatal("Expected failure because of too few header columns did "
+                 "not occur; the file was opened.");
+    }
+}
+
 Test(csv, space_before_quote) {
     wchar_t *val;
     size_t unitCnt;
@@ -550,6 +575,34 @@ define_assert(file_open, int fieldCnt, int header) {
         cr_assert_failure("Failed to open the test file.");
 }
 
+define_assert(file_open_variable,
+              size_t minFieldCnt,
+              size_t maxFieldCnt,
+              size_t fieldCnt) {
+    char *name;
+    wchar_t path[2048];
+    size_t cnt;
+
+    name = (char*) criterion_current_test->name;
+    if (StringCbPrintfW(path, sizeof(path), L"csv\\%S.csv", name) != S_OK)
+    {
+        cr_assert_failure("The test name is unreasonably long or the path "
+                          "buffer is unrealistically small.");
+    }
+
+    if (csvOpenVariable(path, minFieldCnt, maxFieldCnt, &cnt))
+        cr_assert_failure("Failed to open the test file.");
+
+    if (cnt != fieldCnt)
+    {
+        csvClose();
+        cr_assert_failure("The header consists of %lu columns, but %lu "
+                          "columns were expected.",
+                          (unsigned long) cnt,
+                          (unsigned long) fieldCnt);
+    }
+}
+
 define_assert(file_read) {
     if (csvHasData())
     {
@@ -0,0 +1,65 @@
+/*
+This file is part of NppEventExec
+Copyright (C) 2016-2017 Mihail Ivanchev
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "test.h"
+#include "exclusion.h"
+
+Test(exclusion, lookup)
+{
+    ExclusionStats stats;
+
+    if (loadExclusions(L"exclusion\\list.txt"))
+        cr_fatal("Failed to load the exclusion list.");
+
+    getExclusionStats(&stats);
+    cr_expect(stats.prefixCnt == 4,
+              "The list has %lu prefixes instead of 4.",
+              (unsigned long) stats.prefixCnt);
+
+    cr_expect(isPathExcluded(L"D:\\repos\\app\\node_modules\\a\\b.js"),
+              "A file in an excluded directory wasn't excluded.");
+    cr_expect(isPathExcluded(L"d:\\REPOS\\APP\\Build\\app.exe"),
+              "The comparison isn't case-insensitive.");
+    cr_expect(isPathExcluded(L"D:/repos//app\\build\\\\app.o"),
+              "Separators aren't treated alike.");
+    cr_expect(isPathExcluded(L"\\\\server\\share\\vendor\\lib.c"),
+              "A file on a network share wasn't excluded.");
+    cr_expect(isPathExcluded(L"D:\\repos\\app\\gen\\version.h"),
+              "An excluded file wasn't excluded.");
+    cr_expect(!isPathExcluded(L"D:\\repos\\app\\node_modules2\\b.js"),
+              "A directory was excluded by a prefix of its name.");
+    cr_expect(!isPathExcluded(L"D:\\repos\\app\\src\\build.c"),
+              "A file named like an excluded directory was excluded.");
+    cr_expect(!isPathExcluded(L"D:\\repos\\app\\gen\\version.h.in"),
+              "A file was excluded by a prefix of its name.");
+
+    clearExclusions();
+
+    cr_expect(!isPathExcluded(L"D:\\repos\\app\\node_modules\\a\\b.js"),
+              "A path was excluded by a cleared list.");
+}
+
+Test(exclusion, missing_file)
+{
+    ExclusionStats stats;
+
+    cr_expect(!loadExclusions(L"exclusion\\missing.txt"),
+              "A missing exclusion list wasn't accepted.");
+
+    getExclusionStats(&stats);
+    cr_expect(stats.prefixCnt == 0, "A missing exclusion list isn't empty.");
+}
@@ -0,0 +1,105 @@
+/*
+This file is part of NppEventExec
+Copyright (C) 2016-2017 Mihail Ivanchev
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "test.h"
+#include "glob.h"
+
+static void expectGlob(const wchar_t *globs, const wchar_t *path, bool match);
+
+Test(glob, suffixes)
+{
+    /* Patterns of the form *<literal> are looked up in the suffix set, the
+    ** lengths differ so the path is hashed more than once.
+    */
+
+    expectGlob(L"*.c;*.cpp;*.h", L"C:\\src\\main.c", true);
+    expectGlob(L"*.c;*.cpp;*.h", L"C:\\src\\main.cpp", true);
+    expectGlob(L"*.c;*.cpp;*.h", L"main.h", true);
+    expectGlob(L"*.c;*.cpp;*.h", L"C:\\src\\main.cc", false);
+    expectGlob(L"*.c;*.cpp;*.h", L"C:\\src\\main.c.bak", false);
+    expectGlob(L"*.c;*.cpp;*.h", L"c", false);
+    expectGlob(L"*.c;*.c", L"C:\\src\\main.c", true);
+
+    /* A suffix with a separator is matched against the whole path. */
+
+    expectGlob(L"*\\gen\\version.h", L"D:\\app\\gen\\version.h", true);
+    expectGlob(L"*\\gen\\version.h", L"D:\\app\\src\\version.h", false);
+}
+
+Test(glob, wildcards)
+{
+    expectGlob(L"*", L"C:\\src\\main.c", true);
+    expectGlob(L"main.?", L"C:\\src\\main.c", true);
+    expectGlob(L"main.?", L"C:\\src\\main.cc", false);
+    expectGlob(L"Make????", L"C:\\src\\Makefile", true);
+    expectGlob(L"Make????", L"C:\\src\\Make", false);
+    expectGlob(L"test_*.c", L"C:\\src\\test_glob.c", true);
+    expectGlob(L"test_*.c", L"C:\\src\\test_glob.h", false);
+    expectGlob(L"a*b*c", L"C:\\src\\axxbyybzc", true);
+    expectGlob(L"a*b*c", L"C:\\src\\axxbyybzcd", false);
+    expectGlob(L"*.*.bak", L"C:\\src\\main.c.bak", true);
+
+    /* Patterns without a separator only see the filename. */
+
+    expectGlob(L"src*", L"C:\\src\\main.c", false);
+    expectGlob(L"main.c", L"C:\\main.c\\util.h", false);
+
+    /* Patterns with a separator see the whole path. */
+
+    expectGlob(L"*\\src\\*.c", L"C:\\app\\src\\main.c", true);
+    expectGlob(L"*\\src\\*.c", L"C:\\app\\lib\\main.c", false);
+    expectGlob(L"C:\\app\\*", L"C:\\app\\src\\main.c", true);
+}
+
+Test(glob, folding)
+{
+    expectGlob(L"*.CPP", L"C:\\src\\main.cpp", true);
+    expectGlob(L"*.cpp", L"C:\\SRC\\MAIN.CPP", true);
+    expectGlob(L"MAIN.?", L"C:\\src\\main.C", true);
+    expectGlob(L"*/gen/version.h", L"D:\\App\\Gen\\Version.h", true);
+    expectGlob(L"*\\src\\*.c", L"C:/app/SRC/main.c", true);
+    expectGlob(L"C:/app/*", L"c:\\APP\\main.c", true);
+}
+
+Test(glob, lists)
+{
+    GlobMatcher *matcher;
+
+    expectGlob(L" *.c ; Makefile ", L"C:\\src\\Makefile", true);
+    expectGlob(L" *.c ; Makefile ", L"C:\\src\\main.c", true);
+
+    cr_expect(!(matcher = compileGlob(L"*.c;;*.h")),
+              "A list with an empty pattern was compiled.");
+    freeGlob(matcher);
+    cr_expect(!(matcher = compileGlob(L" ")),
+              "A blank list was compiled.");
+    freeGlob(matcher);
+}
+
+void expectGlob(const wchar_t *globs, const wchar_t *path, bool match)
+{
+    GlobMatcher *matcher;
+
+    if (!(matcher = compileGlob(globs)))
+        cr_fatal("Failed to compile \"%ls\".", globs);
+
+    cr_expect(!isGlobMatch(matcher, path) == !match,
+              "\"%ls\" %ls %ls.", globs, match ? L"doesn't match"
+                                               : L"matches", path);
+
+    freeGlob(matcher);
+}
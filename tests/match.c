@@ -0,0 +1,378 @@
+/*
+This file is part of NppEventExec
+Copyright (C) 2016-2017 Mihail Ivanchev
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "test.h"
+#include "match.h"
+#include <time.h>
+
+/** The number of generated patterns. */
+#define PATTERN_CNT 4096
+
+/** The number of generated paths checked against every pattern. */
+#define PATH_CNT 64
+
+/** The number of patterns compiled into a single rule set matcher. */
+#define RULE_SET_SIZE 64
+
+/** The maximum nesting depth of groups in generated patterns. */
+#define MAX_DEPTH 3
+
+/** The size of the buffers of the generated patterns. */
+#define MAX_PATTERN_LEN 256
+
+/** The maximum length of a generated path. */
+#define MAX_PATH_LEN 16
+
+typedef struct
+{
+    wchar_t buf[MAX_PATTERN_LEN];
+    size_t len;
+} Pattern;
+
+static void genPattern(Pattern *pattern);
+static void genJunk(Pattern *pattern);
+static void genAlt(Pattern *pattern, unsigned int depth);
+static void genConcat(Pattern *pattern, unsigned int depth);
+static void genAtom(Pattern *pattern, unsigned int depth);
+static void genQuantifier(Pattern *pattern);
+static void append(Pattern *pattern, const wchar_t *str);
+static void genPath(wchar_t *path);
+static unsigned int randUpTo(unsigned int max);
+static void init(void);
+
+TestSuite(match, .init = init);
+
+Test(match, backend_selection)
+{
+    Matcher *matcher;
+
+    if (!(matcher = compileMatcher(L".*[^.]\\.(c|cpp|h|hpp)")))
+        cr_fatal("Failed to compile a regular pattern.");
+
+    cr_expect(getMatcherBackend(matcher) == getDfaBackend(),
+              "A regular pattern wasn't compiled by the DFA backend.");
+    freeMatcher(matcher);
+
+    if (!(matcher = compileMatcher(L"(a)\\1")))
+        cr_fatal("Failed to compile a pattern with a back-reference.");
+
+    cr_expect(getMatcherBackend(matcher) == getBoostBackend(),
+              "A pattern with a back-reference wasn't compiled by boost.");
+    freeMatcher(matcher);
+
+    cr_expect(!compileMatcher(L"(a"), "An invalid pattern was compiled.");
+}
+
+Test(match, differential)
+{
+    Pattern pattern;
+    wchar_t path[MAX_PATH_LEN + 1];
+    Matcher *dfa;
+    Matcher *boost;
+    unsigned int dfaCnt;
+    unsigned int ii;
+    unsigned int jj;
+    int res;
+
+    dfaCnt = 0;
+
+    for (ii = 0; ii < PATTERN_CNT; ii++)
+    {
+        /* Malformed patterns are generated as well, the DFA must not accept
+        ** any pattern boost rejects.
+        */
+
+        if (ii % 4)
+            genPattern(&pattern);
+        else
+            genJunk(&pattern);
+
+        dfa = compileMatcherWith(getDfaBackend(), pattern.buf);
+        boost = compileMatcherWith(getBoostBackend(), pattern.buf);
+
+        if (dfa && !boost)
+        {
+            freeMatcher(dfa);
+            cr_fatal("The DFA accepts the pattern \"%ls\", but boost doesn't.",
+                     pattern.buf);
+        }
+        if (!dfa)
+        {
+            freeMatcher(boost);
+            continue;
+        }
+
+        for (jj = 0; jj < PATH_CNT; jj++)
+        {
+            genPath(path);
+
+            /* Boost gives up on some nested quantifiers. */
+
+            if ((res = isMatch(boost, path)) < 0)
+                continue;
+
+            if (isMatch(dfa, path) != res)
+            {
+                freeMatcher(dfa);
+                freeMatcher(boost);
+                cr_fatal("The engines disagree on the pattern \"%ls\" and the "
+                         "path \"%ls\".", pattern.buf, path);
+            }
+        }
+
+        freeMatcher(dfa);
+        freeMatcher(boost);
+        dfaCnt++;
+    }
+
+    cr_log_info("Number of patterns compared during differential test: %u\n",
+                dfaCnt);
+}
+
+Test(match, rule_set)
+{
+    Pattern patterns[RULE_SET_SIZE];
+    const wchar_t *strs[RULE_SET_SIZE];
+    Matcher *matchers[RULE_SET_SIZE];
+    size_t matches[RULE_SET_SIZE];
+    wchar_t path[MAX_PATH_LEN + 1];
+    RuleSetMatcher *ruleSet;
+    size_t matchCnt;
+    size_t next;
+    unsigned int ii;
+    unsigned int jj;
+    int res;
+
+    /* Every pattern is matched with boost on its own and as part of the rule
+    ** set. Enough paths are checked to overflow the DFA cache several times.
+    */
+
+    for (ii = 0; ii < RULE_SET_SIZE; ii++)
+    {
+        do
+        {
+            genPattern(&patterns[ii]);
+        }
+        while (!(matchers[ii] = compileMatcherWith(getBoostBackend(),
+                                                   patterns[ii].buf)));
+
+        strs[ii] = patterns[ii].buf;
+    }
+
+    if (!(ruleSet = compileRuleSetMatcher(strs,
+                                          (const Matcher *const *) matchers,
+                                          RULE_SET_SIZE)))
+    {
+        cr_fatal("Failed to compile the rule set matcher.");
+    }
+
+    for (ii = 0; ii < PATTERN_CNT; ii++)
+    {
+        genPath(path);
+        matchCnt = matchRuleSet(ruleSet, path, matches);
+        next = 0;
+
+        for (jj = 0; jj < RULE_SET_SIZE; jj++)
+        {
+            res = isMatch(matchers[jj], path);
+
+            if (res >= 0
+                && !isPatternAborted(ruleSet, jj)
+                && res != (next < matchCnt && matches[next] == jj))
+            {
+                cr_fatal("The rule set matcher disagrees with boost on the "
+                         "pattern \"%ls\" and the path \"%ls\".",
+                         strs[jj], path);
+            }
+            if (next < matchCnt && matches[next] == jj)
+                next++;
+        }
+    }
+
+    freeRuleSetMatcher(ruleSet);
+
+    for (ii = 0; ii < RULE_SET_SIZE; ii++)
+        freeMatcher(matchers[ii]);
+}
+
+Test(match, slow_patterns)
+{
+    const wchar_t *strs[] = {L"(\\w+\\w+)+x\\b", L"a.*"};
+    Matcher *matchers[2];
+    size_t matches[2];
+    RuleSetMatcher *ruleSet;
+    size_t matchCnt;
+
+    if (!(matchers[0] = compileMatcher(strs[0])))
+        cr_fatal("Failed to compile an exponential pattern.");
+    if (!(matchers[1] = compileMatcher(strs[1])))
+        cr_fatal("Failed to compile a regular pattern.");
+
+    cr_expect(isExponentialRegex(matchers[0], strs[0]),
+              "An exponential pattern wasn't detected.");
+    cr_expect(!isExponentialRegex(matchers[1], strs[1]),
+              "A regular pattern was reported as exponential.");
+    cr_expect(isMatch(matchers[0], L"aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaa")
+              == -1,
+              "Matching an exponential pattern wasn't aborted.");
+
+    if (!(ruleSet = compileRuleSetMatcher(strs,
+                                          (const Matcher *const *) matchers,
+                                          2)))
+    {
+        cr_fatal("Failed to compile the rule set matcher.");
+    }
+
+    matchCnt = matchRuleSet(ruleSet,
+                            L"aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaa",
+                            matches);
+
+    cr_expect(matchCnt == 1 && matches[0] == 1,
+              "The rule set matcher didn't match the regular pattern.");
+    cr_expect(getAbortedPatternCount(ruleSet) == 1
+              && isPatternAborted(ruleSet, 0),
+              "The exponential pattern wasn't aborted.");
+
+    matchCnt = matchRuleSet(ruleSet, L"aax", matches);
+
+    cr_expect(matchCnt == 1 && matches[0] == 1,
+              "An aborted pattern matched again.");
+
+    freeRuleSetMatcher(ruleSet);
+    freeMatcher(matchers[0]);
+    freeMatcher(matchers[1]);
+}
+
+void genPattern(Pattern *pattern)
+{
+    pattern->len = 0;
+    pattern->buf[0] = L'\0';
+
+    genAlt(pattern, 0);
+}
+
+void genJunk(Pattern *pattern)
+{
+    static const wchar_t chars[] = L"ab.\\*+?()[]{}|^$-,12";
+    unsigned int len;
+
+    len = randUpTo(8);
+
+    for (pattern->len = 0; pattern->len < len; pattern->len++)
+        pattern->buf[pattern->len] = chars[randUpTo(BUFLEN(chars) - 2)];
+
+    pattern->buf[pattern->len] = L'\0';
+}
+
+void genAlt(Pattern *pattern, unsigned int depth)
+{
+    genConcat(pattern, depth);
+
+    while (!randUpTo(3))
+    {
+        append(pattern, L"|");
+        genConcat(pattern, depth);
+    }
+}
+
+void genConcat(Pattern *pattern, unsigned int depth)
+{
+    unsigned int cnt;
+
+    for (cnt = randUpTo(3); cnt; cnt--)
+    {
+        genAtom(pattern, depth);
+
+        if (!randUpTo(2))
+            genQuantifier(pattern);
+    }
+}
+
+void genAtom(Pattern *pattern, unsigned int depth)
+{
+    static const wchar_t *const atoms[] = {
+        L"a", L"b", L"c", L".", L"\\.", L"\\\\", L"/", L":",
+        L"[ab]", L"[^a]", L"[a-c]", L"[.\\\\]", L"[^\\\\/]", L"^", L"$",
+        L"\\`", L"\\'", L"\\<", L"\\>"
+    };
+
+    if (depth < MAX_DEPTH && !randUpTo(4))
+    {
+        append(pattern, randUpTo(1) ? L"(" : L"(?:");
+        genAlt(pattern, depth + 1);
+        append(pattern, L")");
+    }
+    else
+    {
+        append(pattern, atoms[randUpTo(BUFLEN(atoms) - 1)]);
+    }
+}
+
+void genQuantifier(Pattern *pattern)
+{
+    static const wchar_t *const quantifiers[] = {
+        L"*", L"+", L"?", L"*?", L"+?", L"??", L"{2}", L"{1,2}", L"{0,}",
+        L"{1,3}?"
+    };
+
+    append(pattern, quantifiers[randUpTo(BUFLEN(quantifiers) - 1)]);
+}
+
+void append(Pattern *pattern, const wchar_t *str)
+{
+    size_t len;
+
+    /* Patterns which don't fit are cut off, which makes them malformed at
+    ** worst.
+    */
+
+    len = wcslen(str);
+
+    if (pattern->len + len >= MAX_PATTERN_LEN)
+        return;
+
+    wmemcpy(pattern->buf + pattern->len, str, len + 1);
+    pattern->len += len;
+}
+
+void genPath(wchar_t *path)
+{
+    static const wchar_t chars[] = L"abc.\\/:";
+    unsigned int len;
+    unsigned int ii;
+
+    len = randUpTo(MAX_PATH_LEN);
+
+    for (ii = 0; ii < len; ii++)
+        path[ii] = chars[randUpTo(BUFLEN(chars) - 2)];
+
+    path[len] = L'\0';
+}
+
+unsigned int randUpTo(unsigned int max)
+{
+    return rand() % (max + 1);
+}
+
+void init(void)
+{
+    unsigned int seed;
+
+    seed = time(NULL) % UINT_MAX;
+    cr_log_info("Random seed of the match tests: %u\n", seed);
+    srand(seed);
+}
@@ -0,0 +1,120 @@
+/*
+This file is part of NppEventExec
+Copyright (C) 2016-2017 Mihail Ivanchev
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "test.h"
+#include "util.h"
+#include "path_scan.h"
+
+/* The paths are longer than a couple of vectors, so both the vector and the
+** scalar code paths are taken depending on the length of the range. The
+** second one has non-ASCII code units inside vectors, which are folded by
+** the fallback of the vector loops.
+*/
+
+static const wchar_t *const paths[] = {
+    L"C:\\Projects/NppEventExec\\Src\\Rule_Table.C",
+    L"C:\\Projekte/\u00C4nderungen\\Src\\Gr\u00D6\u00DFe.TXT"
+};
+
+/** The length of the longest path. */
+#define MAX_PATH_LEN 41
+
+static void expectSeparators(const wchar_t *path);
+static void expectFolded(const wchar_t *path);
+
+Test(path_scan, find_separator)
+{
+    size_t ii;
+
+    for (ii = 0; ii < BUFLEN(paths); ii++)
+        expectSeparators(paths[ii]);
+}
+
+Test(path_scan, fold_range)
+{
+    size_t ii;
+
+    for (ii = 0; ii < BUFLEN(paths); ii++)
+        expectFolded(paths[ii]);
+}
+
+void expectSeparators(const wchar_t *path)
+{
+    const wchar_t *end;
+    const wchar_t *sep;
+    const wchar_t *last;
+    size_t len;
+    size_t ii;
+
+    for (len = 0; len <= wcslen(path); len++)
+    {
+        end = path + len;
+        sep = path;
+        last = NULL;
+
+        while (sep < end && !IS_PATH_SEPARATOR(*sep))
+            sep++;
+
+        for (ii = 0; ii < len; ii++)
+        {
+            if (IS_PATH_SEPARATOR(path[ii]))
+                last = path + ii;
+        }
+
+        cr_expect(findSeparator(path, end) == sep,
+                  "Wrong first separator in the first %lu units of %ls.",
+                  (unsigned long) len, path);
+        cr_expect(findLastSeparator(path, end) == last,
+                  "Wrong last separator in the first %lu units of %ls.",
+                  (unsigned long) len, path);
+    }
+}
+
+void expectFolded(const wchar_t *path)
+{
+    wchar_t folded[MAX_PATH_LEN];
+    size_t len;
+    size_t ii;
+
+    assert(wcslen(path) <= MAX_PATH_LEN);
+
+    for (len = 0; len <= wcslen(path); len++)
+    {
+        foldPathRange(folded, path, len);
+
+        for (ii = 0; ii < len; ii++)
+        {
+            if (folded[ii] != foldPathChar(path[ii]))
+                break;
+        }
+
+        cr_expect(ii == len,
+                  "The first %lu units of %ls were folded incorrectly.",
+                  (unsigned long) len, path);
+        cr_expect(isFoldedRange(folded, path, len),
+                  "The first %lu units of %ls don't match their folded form.",
+                  (unsigned long) len, path);
+
+        if (len)
+        {
+            folded[len - 1] = L'#';
+            cr_expect(!isFoldedRange(folded, path, len),
+                      "The first %lu units of %ls match a different range.",
+                      (unsigned long) len, path);
+        }
+    }
+}
@@ -0,0 +1,113 @@
+/*
+This file is part of NppEventExec
+Copyright (C) 2016-2017 Mihail Ivanchev
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "test.h"
+#include "mem.h"
+#include "pool.h"
+
+/* As many objects as a queue of executions could hold during a burst. */
+
+#define OBJ_CNT 1000
+#define OBJ_SIZE 40
+#define OBJS_PER_SLAB 32
+
+Test(pool, amortized_allocs)
+{
+    Pool pool = POOL_INITIALIZER(OBJ_SIZE, OBJS_PER_SLAB);
+    unsigned char *objs[OBJ_CNT];
+    unsigned long prevBytes;
+    size_t slabCnt;
+    size_t ii;
+    size_t jj;
+
+    prevBytes = allocatedBytes;
+
+    for (ii = 0; ii < OBJ_CNT; ii++)
+    {
+        if (!(objs[ii] = allocFromPool(&pool)))
+            cr_fatal("Failed to allocate object %lu.", (unsigned long) ii);
+
+        cr_expect(!((uintptr_t) objs[ii] % MEMORY_ALLOCATION_ALIGNMENT),
+                  "Object %lu is not aligned.", (unsigned long) ii);
+        memset(objs[ii], (int) ii, OBJ_SIZE);
+    }
+
+    /* The heap is only touched once per slab. */
+
+    slabCnt = pool.slabCnt;
+    cr_expect(slabCnt == (OBJ_CNT + OBJS_PER_SLAB - 1) / OBJS_PER_SLAB,
+              "Unexpected number of slabs: %lu", (unsigned long) slabCnt);
+
+    for (ii = 0; ii < OBJ_CNT; ii++)
+    {
+        for (jj = 0; jj < OBJ_SIZE; jj++)
+        {
+            if (objs[ii][jj] != (unsigned char) ii)
+                break;
+        }
+
+        cr_expect(jj == OBJ_SIZE, "Object %lu overlaps another one.",
+                  (unsigned long) ii);
+    }
+
+    /* Returned objects are reused, so the same number of objects can be
+    ** taken again and again without any further allocation.
+    */
+
+    for (jj = 0; jj < 10; jj++)
+    {
+        for (ii = 0; ii < OBJ_CNT; ii++)
+            freeToPool(&pool, objs[ii]);
+        for (ii = 0; ii < OBJ_CNT; ii++)
+        {
+            if (!(objs[ii] = allocFromPool(&pool)))
+                cr_fatal("Failed to reallocate object %lu.", (unsigned long) ii);
+        }
+    }
+
+    cr_expect(pool.slabCnt == slabCnt, "Reused objects caused new slabs.");
+
+    for (ii = 0; ii < OBJ_CNT; ii++)
+        freeToPool(&pool, objs[ii]);
+
+    clearPool(&pool);
+
+    cr_expect(!pool.slabCnt, "Slabs left after clearing the pool.");
+    cr_expect(allocatedBytes == prevBytes, "%lu bytes were leaked.",
+              allocatedBytes - prevBytes);
+}
+
+Test(pool, reuse_last_freed)
+{
+    Pool pool = POOL_INITIALIZER(OBJ_SIZE, OBJS_PER_SLAB);
+    void *obj1;
+    void *obj2;
+
+    /* The most recently returned object is still in the cache. */
+
+    if (!(obj1 = allocFromPool(&pool)) || !(obj2 = allocFromPool(&pool)))
+        cr_fatal("Failed to allocate the objects.");
+    cr_expect(obj1 != obj2, "The same object was handed out twice.");
+
+    freeToPool(&pool, obj1);
+    cr_expect(allocFromPool(&pool) == obj1,
+              "The last returned object was not reused.");
+
+    freeToPool(&pool, obj1);
+    freeToPool(&pool, obj2);
+    clearPool(&pool);
+}
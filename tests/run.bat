@@ -18,11 +18,18 @@ rem along with this program. If not, see <http://www.gnu.org/licenses/>.
 
 set CRITERION_INC_PATH=..\..\..\..\Libs\C\Criterion\include
 set CRITERION_LIB_PATH=..\..\..\..\Libs\C\Criterion\build
+set BOOST_INC_PATH=..\..\..\..\Libs\CPP\boost_1_58_0
+set BOOST_LIB_PATH=..\..\..\..\Libs\CPP\boost_1_58_0\stage\lib
 set EXE=tests.exe
 
-gcc -g -DDEBUG -I%CRITERION_INC_PATH% -I.. -L%CRITERION_LIB_PATH% -o %EXE% csv.c csv_gen.c test.c ..\csv.c ..\mem.c ..\util.c ..\event_map.c ..\utf8.c -lcriterion
+g++ -c -g -DDEBUG -I%BOOST_INC_PATH% -I.. -o match.o ..\match.cpp
 if %errorlevel% neq 0 exit /b %errorlevel%
 
+gcc -g -DDEBUG -I%CRITERION_INC_PATH% -I.. -L%CRITERION_LIB_PATH% -L%BOOST_LIB_PATH% -o %EXE% csv.c csv_gen.c exclusion.c glob.c match.c path_scan.c pool.c scope.c test.c util.c ..\csv.c ..\mem.c ..\util.c ..\event_map.c ..\utf8.c ..\scope.c ..\exclusion.c ..\glob.c ..\path_scan.c ..\pool.c match.o -lcriterion -lboost_regex-mgw62-mt-sd-1_58 -lstdc++
+set RESULT=%errorlevel%
+del match.o
+if %RESULT% neq 0 exit /b %RESULT%
+
 %EXE% --ascii --verbose %1 %2 %3 %4 %5 %6 %7 %8 %9
 
 set RESULT=%errorlevel%
@@ -0,0 +1,95 @@
+/*
+This file is part of NppEventExec
+Copyright (C) 2016-2017 Mihail Ivanchev
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "test.h"
+#include "scope.h"
+
+/** The number of scopes in the test. */
+#define SCOPE_CNT 8
+
+static const wchar_t *scopes[SCOPE_CNT] = {
+    L"C:\\Projects\\App",
+    NULL,
+    L"c:/projects/app/src/",
+    L"C:\\Projects\\Lib",
+    L"\\\\Server\\Share",
+    L"C:\\Projects\\App",
+    L"\\",
+    L"C:\\Projects\\AppData"
+};
+
+static size_t findSorted(const ScopeTrie *trie,
+                         const wchar_t *path,
+                         size_t *indices);
+
+Test(scope, lookup)
+{
+    ScopeTrie *trie;
+    size_t indices[SCOPE_CNT];
+    size_t cnt;
+
+    if (!(trie = buildScopeTrie(scopes, SCOPE_CNT)))
+        cr_fatal("Failed to build the trie.");
+
+    cnt = findSorted(trie, L"C:\\Projects\\App\\main.c", indices);
+    cr_expect(cnt == 3 && indices[0] == 0 && indices[1] == 5
+              && indices[2] == 6,
+              "A file directly in a scope wasn't found.");
+
+    cnt = findSorted(trie, L"C:\\PROJECTS\\APP\\SRC\\Util\\util.c", indices);
+    cr_expect(cnt == 4 && indices[0] == 0 && indices[1] == 2
+              && indices[2] == 5 && indices[3] == 6,
+              "A file in nested scopes wasn't found case-insensitively.");
+
+    cnt = findSorted(trie, L"C:\\Projects\\App.c", indices);
+    cr_expect(cnt == 1 && indices[0] == 6,
+              "A file named like a scope was considered part of it.");
+
+    cnt = findSorted(trie, L"C:\\Projects\\AppData\\x.txt", indices);
+    cr_expect(cnt == 2 && indices[0] == 6 && indices[1] == 7,
+              "A scope matched a directory it is a prefix of.");
+
+    cnt = findSorted(trie, L"\\\\server\\share\\doc.txt", indices);
+    cr_expect(cnt == 2 && indices[0] == 4 && indices[1] == 6,
+              "A file on a network share wasn't found.");
+
+    freeScopeTrie(trie);
+}
+
+size_t findSorted(const ScopeTrie *trie,
+                  const wchar_t *path,
+                  size_t *indices)
+{
+    size_t cnt;
+    size_t tmp;
+    size_t ii;
+    size_t jj;
+
+    cnt = findScopes(trie, path, indices);
+
+    for (ii = 1; ii < cnt; ii++)
+    {
+        for (jj = ii; jj && indices[jj - 1] > indices[jj]; jj--)
+        {
+            tmp = indices[jj];
+            indices[jj] = indices[jj - 1];
+            indices[jj - 1] = tmp;
+        }
+    }
+
+    return cnt;
+}
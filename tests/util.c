@@ -0,0 +1,52 @@
+/*
+This file is part of NppEventExec
+Copyright (C) 2016-2017 Mihail Ivanchev
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "test.h"
+#include "util.h"
+
+static void expectCanonical(const wchar_t *path, const wchar_t *expected);
+
+Test(util, canonicalize_path)
+{
+    /* The paths don't exist, so the short names are kept as they are. */
+
+    expectCanonical(L"C:\\Projects\\App\\Main.C",
+                    L"c:\\projects\\app\\main.c");
+    expectCanonical(L"C:/Projects//App\\\\src/",
+                    L"c:\\projects\\app\\src\\");
+    expectCanonical(L"\\\\?\\C:\\Projects\\PROGRA~1\\x.txt",
+                    L"c:\\projects\\progra~1\\x.txt");
+    expectCanonical(L"\\\\?\\UNC\\Server\\Share\\Doc.txt",
+                    L"\\\\server\\share\\doc.txt");
+    expectCanonical(L"//Server/Share/Doc.txt",
+                    L"\\\\server\\share\\doc.txt");
+    expectCanonical(L"new 1", L"new 1");
+}
+
+void expectCanonical(const wchar_t *path, const wchar_t *expected)
+{
+    wchar_t *canonical;
+
+    if (!(canonical = canonicalizePath(path)))
+        cr_fatal("Failed to canonicalize %ls.", path);
+
+    cr_expect(!wcscmp(canonical, expected),
+              "%ls was canonicalized to %ls instead of %ls.",
+              path, canonical, expected);
+
+    freeStr(canonical);
+}
@@ -19,6 +19,7 @@ along with this program. If not, see <http://www.gnu.org/licenses/>.
 #include "mem.h"
 #include "plugin.h"
 #include "util.h"
+#include "path_scan.h"
 #include <math.h>
 
 typedef struct
@@ -92,20 +93,115 @@ void freeStr(wchar_t *str)
 
 wchar_t* getFilename(const wchar_t *path)
 {
-    wchar_t *fname;
-    wchar_t *chr;
+    const wchar_t *sep;
 
     assert(path);
 
-    fname = (wchar_t*) path;
+    sep = findLastSeparator(path, path + wcslen(path));
 
-    for (chr = fname; *chr != L'\0'; chr++)
+    return (wchar_t*) (sep ? sep + 1 : path);
+}
+
+wchar_t foldPathChar(wchar_t chr)
+{
+    if (chr == L'\\')
+        return L'/';
+    if (chr < 0x80)
+        return chr >= L'A' && chr <= L'Z' ? chr - L'A' + L'a' : chr;
+
+    /* CharLowerW converts a single character if the high word is zero. */
+
+    return (wchar_t) (ULONG_PTR) CharLowerW((LPWSTR) (ULONG_PTR) chr);
+}
+
+wchar_t* canonicalizePath(const wchar_t *path)
+{
+    const wchar_t *src;
+    const wchar_t *end;
+    const wchar_t *sep;
+    wchar_t *longPath;
+    wchar_t *res;
+    wchar_t *dest;
+    DWORD len;
+    DWORD longLen;
+
+    assert(path);
+
+    /* The canonical form is case-folded, uses long names and single
+    ** backslashes as separators and has no \\?\ prefix. Two paths which
+    ** Windows resolves to the same file mostly end up equal this way.
+    */
+
+    /* Short names can only be expanded for files which exist, the path is
+    ** kept as it is otherwise, e.g. for new documents or if the file was
+    ** removed after the length was queried.
+    */
+
+    longPath = NULL;
+
+    if ((len = GetLongPathNameW(path, NULL, 0))
+        && (longPath = allocStr(len))
+        && (!(longLen = GetLongPathNameW(path, longPath, len))
+            || longLen >= len))
+    {
+        freeStr(longPath);
+        longPath = NULL;
+    }
+
+    src = longPath ? longPath : path;
+
+    if (!(res = allocStr(wcslen(src) + 1)))
     {
-        if (*chr == L'\\')
-            fname = chr + 1;
+        /* TODO error */
+        freeStr(longPath);
+        return NULL;
     }
 
-    return fname;
+    dest = res;
+
+    if (!wcsncmp(src, L"\\\\?\\UNC\\", 8))
+    {
+        *dest++ = L'\\';
+        *dest++ = L'\\';
+        src += 8;
+    }
+    else if (!wcsncmp(src, L"\\\\?\\", 4))
+    {
+        src += 4;
+    }
+    else if (IS_PATH_SEPARATOR(src[0]) && IS_PATH_SEPARATOR(src[1]))
+    {
+        *dest++ = L'\\';
+        *dest++ = L'\\';
+        src += 2;
+    }
+
+    /* The separators are unified and collapsed, everything else is folded. */
+
+    end = src + wcslen(src);
+
+    while (src < end)
+    {
+        if (IS_PATH_SEPARATOR(*src))
+        {
+            if (dest == res || dest[-1] != L'\\')
+                *dest++ = L'\\';
+
+            src++;
+            continue;
+        }
+
+        sep = findSeparator(src, end);
+        foldPathRange(dest, src, sep - src);
+        dest += sep - src;
+        src = sep;
+    }
+
+    *dest = L'\0';
+
+    freeStr(longPath);
+
+    return res;
 }
 
 wchar_t* combinePaths(const wchar_t *parent, const wchar_t *child)
@@ -18,6 +18,8 @@ along with this program. If not, see <http://www.gnu.org/licenses/>.
 #ifndef __UTIL_H__
 #define __UTIL_H__
 
+#define IS_PATH_SEPARATOR(chr) ((chr) == L'\\' || (chr) == L'/')
+
 typedef struct
 {
     HWND hWnd;
@@ -50,6 +52,8 @@ wchar_t* allocStr(size_t unitCnt);
 wchar_t* reallocStr(wchar_t *str, size_t unitCnt);
 void freeStr(wchar_t *str);
 wchar_t* getFilename(const wchar_t *path);
+wchar_t foldPathChar(wchar_t chr);
+wchar_t* canonicalizePath(const wchar_t *path);
 wchar_t* combinePaths(const wchar_t *parent, const wchar_t *child);
 void centerWndToParent(HWND wnd);
 int getChildWndCount(HWND wnd);